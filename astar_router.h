@@ -0,0 +1,231 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Маршрутизатор A* без предварительного расчета.
+// Двунаправленный поиск: прямой - из вершины отправления по исходящим ребрам,
+// обратный - из вершины назначения по входящим. Очереди упорядочены по
+// вес + нижняя оценка остатка пути (симметричный вариант A*).
+// Оценка должна быть допустимой и согласованной:
+// lower_bound(u, w) <= вес(u -> v) + lower_bound(v, w) для любого ребра u -> v.
+template <typename Weight>
+class AStarRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    // нижняя оценка веса пути from -> to
+    using LowerBound = std::function<Weight(VertexId from, VertexId to)>;
+
+    // счетчики одного запроса - для сравнения с другими алгоритмами
+    struct SearchStats {
+        // вершины, извлеченные из очередей обоих направлений
+        size_t expanded_vertices = 0;
+    };
+
+    // без оценки поиск сводится к двунаправленному алгоритму Дейкстры
+    explicit AStarRouter(const Graph& graph, LowerBound lower_bound = nullptr);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to, SearchStats* stats = nullptr) const;
+
+private:
+    struct QueueEntry {
+        // вес + нижняя оценка остатка
+        Weight key;
+        VertexId vertex;
+
+        bool operator>(const QueueEntry& other) const {
+            return key > other.key;
+        }
+    };
+    using Queue = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>>;
+
+    Weight GetLowerBound(VertexId from, VertexId to) const;
+
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+    static constexpr Weight ZERO_WEIGHT{};
+
+    const Graph& graph_;
+    const LowerBound lower_bound_;
+
+    // входящие ребра вершин (CSR), индекс - to
+    std::vector<EdgeId> incoming_offsets_;
+    std::vector<EdgeId> incoming_edges_;
+
+    // рабочие массивы запроса; метка поколения вместо очистки массивов
+    struct SearchSide {
+        std::vector<Weight> weights;
+        std::vector<EdgeId> parent_edges;
+        std::vector<uint32_t> visited_generation;
+        std::vector<uint32_t> settled_generation;
+    };
+    mutable std::mutex search_mutex_;
+    mutable SearchSide forward_;
+    mutable SearchSide backward_;
+    mutable uint32_t generation_ = 0;
+};
+
+template <typename Weight>
+AStarRouter<Weight>::AStarRouter(const Graph& graph, LowerBound lower_bound)
+    : graph_(graph)
+    , lower_bound_(std::move(lower_bound))
+{
+    const size_t vertex_count = graph_.GetVertexCount();
+    incoming_offsets_.assign(vertex_count + 1, 0);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (edge.weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        ++incoming_offsets_[edge.to + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        incoming_offsets_[vertex + 1] += incoming_offsets_[vertex];
+    }
+    incoming_edges_.resize(incoming_offsets_.back());
+    std::vector<EdgeId> incoming_fill(incoming_offsets_.begin(), incoming_offsets_.end() - 1);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        incoming_edges_[incoming_fill[graph_.GetEdge(edge_id).to]++] = edge_id;
+    }
+
+    for (SearchSide* side : {&forward_, &backward_}) {
+        side->weights.assign(vertex_count, ZERO_WEIGHT);
+        side->parent_edges.assign(vertex_count, NO_EDGE);
+        side->visited_generation.assign(vertex_count, 0);
+        side->settled_generation.assign(vertex_count, 0);
+    }
+}
+
+template <typename Weight>
+Weight AStarRouter<Weight>::GetLowerBound(VertexId from, VertexId to) const {
+    return lower_bound_ ? lower_bound_(from, to) : ZERO_WEIGHT;
+}
+
+template <typename Weight>
+std::optional<typename AStarRouter<Weight>::RouteInfo>
+AStarRouter<Weight>::BuildRoute(VertexId from, VertexId to, SearchStats* stats) const {
+    if (from >= graph_.GetVertexCount() || to >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}};
+    }
+
+    std::lock_guard guard(search_mutex_);
+    if (++generation_ == 0) {
+        // переполнение счетчика поколений - сбрасываем метки
+        for (SearchSide* side : {&forward_, &backward_}) {
+            std::fill(side->visited_generation.begin(), side->visited_generation.end(), 0);
+            std::fill(side->settled_generation.begin(), side->settled_generation.end(), 0);
+        }
+        generation_ = 1;
+    }
+
+    auto is_visited = [this](const SearchSide& side, VertexId vertex) {
+        return side.visited_generation[vertex] == generation_;
+    };
+
+    Queue forward_queue;
+    Queue backward_queue;
+    forward_.visited_generation[from] = generation_;
+    forward_.weights[from] = ZERO_WEIGHT;
+    forward_.parent_edges[from] = NO_EDGE;
+    forward_queue.push({GetLowerBound(from, to), from});
+    backward_.visited_generation[to] = generation_;
+    backward_.weights[to] = ZERO_WEIGHT;
+    backward_.parent_edges[to] = NO_EDGE;
+    backward_queue.push({GetLowerBound(from, to), to});
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = 0;
+
+    // ключ очереди не больше веса любого пути через ее вершины,
+    // поэтому первая же очередь с ключом не меньше найденного веса завершает поиск
+    auto is_done = [&best_weight](const Queue& queue) {
+        return queue.empty() || (best_weight && !(queue.top().key < *best_weight));
+    };
+
+    bool forward_turn = true;
+    size_t expanded_vertices = 0;
+    while (!is_done(forward_queue) && !is_done(backward_queue)) {
+        const bool forward = forward_turn;
+        forward_turn = !forward_turn;
+        SearchSide& side = forward ? forward_ : backward_;
+        const SearchSide& other_side = forward ? backward_ : forward_;
+        Queue& queue = forward ? forward_queue : backward_queue;
+
+        const VertexId vertex = queue.top().vertex;
+        queue.pop();
+        // в очереди могут остаться устаревшие записи вершины
+        if (side.settled_generation[vertex] == generation_) {
+            continue;
+        }
+        side.settled_generation[vertex] = generation_;
+        ++expanded_vertices;
+
+        const Weight vertex_weight = side.weights[vertex];
+        const EdgeIdIterator begin = forward
+            ? graph_.GetIncidentEdges(vertex).begin()
+            : EdgeIdIterator(incoming_edges_.data(), incoming_offsets_[vertex]);
+        const EdgeIdIterator end = forward
+            ? graph_.GetIncidentEdges(vertex).end()
+            : EdgeIdIterator(incoming_edges_.data(), incoming_offsets_[vertex + 1]);
+        for (EdgeIdIterator it = begin; it != end; ++it) {
+            const auto& edge = graph_.GetEdge(*it);
+            const VertexId next = forward ? edge.to : edge.from;
+            const Weight candidate = vertex_weight + edge.weight;
+            if (is_visited(side, next) && !(candidate < side.weights[next])) {
+                continue;
+            }
+            side.visited_generation[next] = generation_;
+            side.weights[next] = candidate;
+            side.parent_edges[next] = *it;
+            queue.push({candidate + (forward ? GetLowerBound(next, to) : GetLowerBound(from, next)), next});
+
+            if (is_visited(other_side, next)) {
+                const Weight route_weight = candidate + other_side.weights[next];
+                if (!best_weight || route_weight < *best_weight) {
+                    best_weight = route_weight;
+                    meeting_vertex = next;
+                }
+            }
+        }
+    }
+
+    if (stats) {
+        stats->expanded_vertices = expanded_vertices;
+    }
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    // from -> meeting_vertex по прямому поиску, затем meeting_vertex -> to по обратному
+    std::vector<EdgeId> edges;
+    for (VertexId vertex = meeting_vertex; forward_.parent_edges[vertex] != NO_EDGE;
+         vertex = graph_.GetEdge(forward_.parent_edges[vertex]).from) {
+        edges.push_back(forward_.parent_edges[vertex]);
+    }
+    std::reverse(edges.begin(), edges.end());
+    for (VertexId vertex = meeting_vertex; backward_.parent_edges[vertex] != NO_EDGE;
+         vertex = graph_.GetEdge(backward_.parent_edges[vertex]).to) {
+        edges.push_back(backward_.parent_edges[vertex]);
+    }
+    return RouteInfo{*best_weight, std::move(edges)};
+}
+
+}  // namespace graph
@@ -0,0 +1,131 @@
+#include "connection_scan_router.h"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+namespace catalogue {
+
+ConnectionScanRouter::ConnectionScanRouter(const TransportCatalogue& cat, double bus_velocity)
+    : cat_(cat) {
+    for(const Bus& bus : cat_.GetBuses()) {
+        AddTrips(bus, bus_velocity);
+    }
+    // при равном отправлении раньше идут перегоны нулевой длины, а внутри рейса -
+    // перегоны по порядку: по ним можно проехать дальше в том же проходе
+    std::sort(connections_.begin(), connections_.end(),
+              [](const TimetableConnection& lhs, const TimetableConnection& rhs) {
+                  return std::tie(lhs.departure_time, lhs.arrival_time, lhs.trip, lhs.trip_position)
+                       < std::tie(rhs.departure_time, rhs.arrival_time, rhs.trip, rhs.trip_position);
+              });
+}
+
+ConnectionScanRouter::ConnectionScanRouter(const TransportCatalogue& cat,
+                                           std::vector<TimetableTrip> trips,
+                                           std::vector<TimetableConnection> connections)
+    : cat_(cat)
+    , trips_(std::move(trips))
+    , connections_(std::move(connections)) {
+}
+
+void ConnectionScanRouter::AddTrips(const Bus& bus, double bus_velocity) {
+    // рейс обычного автобуса - туда и обратно до первой остановки, кольцевого - по кругу
+    std::vector<const Stop*> stops = bus.stops_;
+    if(bus.bus_type_ != BusType::CYCLED && !stops.empty()) {
+        stops.insert(stops.end(), bus.stops_.rbegin() + 1, bus.stops_.rend());
+    }
+    if(stops.size() < 2 || bus.departures_.empty()) {
+        return;
+    }
+
+    // время от отправления рейса до прибытия на остановку
+    std::vector<double> offsets;
+    offsets.reserve(stops.size());
+    uint64_t distance = 0;
+    offsets.push_back(0.0);
+    for(size_t position = 1; position < stops.size(); ++position) {
+        distance += cat_.GetDistance({stops[position - 1], stops[position]});
+        offsets.push_back(static_cast<double>(distance) / bus_velocity);
+    }
+
+    for(const double departure : bus.departures_) {
+        const uint32_t trip = static_cast<uint32_t>(trips_.size());
+        trips_.push_back({&bus, departure});
+        for(uint32_t position = 0; position + 1 < stops.size(); ++position) {
+            connections_.push_back({
+                static_cast<uint32_t>(stops[position]->id),
+                static_cast<uint32_t>(stops[position + 1]->id),
+                departure + offsets[position],
+                departure + offsets[position + 1],
+                trip,
+                position
+            });
+        }
+    }
+}
+
+std::optional<TimetableJourney> ConnectionScanRouter::FindJourney(const Stop* from, const Stop* to,
+                                                                  double departure_time) const {
+    if(from == to) {
+        return TimetableJourney{departure_time, departure_time, {}};
+    }
+    const size_t stop_count = cat_.GetStops().size();
+    const uint32_t source = static_cast<uint32_t>(from->id);
+    const uint32_t target = static_cast<uint32_t>(to->id);
+    constexpr double UNREACHED = std::numeric_limits<double>::infinity();
+
+    std::vector<double> arrival_times(stop_count, UNREACHED);
+    arrival_times[source] = departure_time;
+    // связь, на которой сели в рейс
+    std::vector<uint32_t> trip_boardings(trips_.size(), NO_CONNECTION);
+    // как доехали до остановки: связь посадки и связь прибытия одного рейса
+    std::vector<std::pair<uint32_t, uint32_t>> journey_pointers(stop_count, {NO_CONNECTION, NO_CONNECTION});
+
+    const auto first = std::lower_bound(connections_.begin(), connections_.end(), departure_time,
+        [](const TimetableConnection& connection, double time) {
+            return connection.departure_time < time;
+        });
+    for(uint32_t i = static_cast<uint32_t>(first - connections_.begin()); i < connections_.size(); ++i) {
+        const TimetableConnection& connection = connections_[i];
+        // дальше связи отправляются не раньше, чем уже можно приехать
+        if(connection.departure_time >= arrival_times[target]) {
+            break;
+        }
+        uint32_t& boarding = trip_boardings[connection.trip];
+        if(boarding == NO_CONNECTION && arrival_times[connection.from_stop] <= connection.departure_time) {
+            boarding = i;
+        }
+        if(boarding != NO_CONNECTION && connection.arrival_time < arrival_times[connection.to_stop]) {
+            arrival_times[connection.to_stop] = connection.arrival_time;
+            journey_pointers[connection.to_stop] = {boarding, i};
+        }
+    }
+    if(arrival_times[target] == UNREACHED) {
+        return std::nullopt;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> leg_connections;
+    for(uint32_t stop = target; stop != source; stop = connections_[journey_pointers[stop].first].from_stop) {
+        leg_connections.push_back(journey_pointers[stop]);
+    }
+    std::reverse(leg_connections.begin(), leg_connections.end());
+
+    TimetableJourney journey{departure_time, arrival_times[target], {}};
+    // ожидание - от прибытия предыдущим участком, а не от лучшего времени до остановки
+    double ready_time = departure_time;
+    for(const auto& [boarding, alighting] : leg_connections) {
+        const TimetableConnection& board = connections_[boarding];
+        const TimetableConnection& alight = connections_[alighting];
+        journey.legs.push_back({
+            &cat_.GetStops()[board.from_stop],
+            trips_[board.trip].bus,
+            static_cast<int>(alight.trip_position - board.trip_position + 1),
+            board.departure_time - ready_time,
+            alight.arrival_time - board.departure_time
+        });
+        ready_time = alight.arrival_time;
+    }
+    return journey;
+}
+
+} // namespace catalogue
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "transport_catalogue.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace catalogue {
+
+// рейс - один выезд автобуса по расписанию
+struct TimetableTrip {
+    const Bus* bus = nullptr;
+    // отправление с первой остановки, мин
+    double departure_time = 0.0;
+};
+
+// связь - перегон рейса между соседними остановками
+struct TimetableConnection {
+    uint32_t from_stop = 0;
+    uint32_t to_stop = 0;
+    double departure_time = 0.0;
+    double arrival_time = 0.0;
+    uint32_t trip = 0;
+    // номер перегона в рейсе - число проеханных остановок считается по разности номеров
+    uint32_t trip_position = 0;
+};
+
+// участок поездки: ожидание на остановке from и проезд span остановок на автобусе bus
+struct TimetableLeg {
+    const Stop* from = nullptr;
+    const Bus* bus = nullptr;
+    int span = 0;
+    double wait_time = 0.0;
+    double ride_time = 0.0;
+};
+
+struct TimetableJourney {
+    double departure_time = 0.0;
+    double arrival_time = 0.0;
+    std::vector<TimetableLeg> legs;
+};
+
+// Поиск по расписанию (Connection Scan): все перегоны всех рейсов лежат одним массивом
+// по возрастанию времени отправления, и запрос - один проход по нему с момента отправления
+// до первого перегона, отправляющегося позже прибытия в остановку назначения.
+// Время поездки между остановками - по расстоянию и RoutingSettings::bus_velocity,
+// пересадка на той же остановке - без запаса времени.
+class ConnectionScanRouter {
+public:
+    // рейсы автобусов справочника с непустым Bus::departures_
+    ConnectionScanRouter(const TransportCatalogue& cat, double bus_velocity);
+    // загруженные из базы рейсы и связи, связи - уже упорядочены
+    ConnectionScanRouter(const TransportCatalogue& cat,
+                         std::vector<TimetableTrip> trips,
+                         std::vector<TimetableConnection> connections);
+
+    // самая ранняя по прибытию поездка с отправлением не раньше departure_time
+    std::optional<TimetableJourney> FindJourney(const Stop* from, const Stop* to, double departure_time) const;
+
+    const std::vector<TimetableTrip>& GetTrips() const {
+        return trips_;
+    }
+    const std::vector<TimetableConnection>& GetConnections() const {
+        return connections_;
+    }
+
+private:
+    void AddTrips(const Bus& bus, double bus_velocity);
+
+    static constexpr uint32_t NO_CONNECTION = std::numeric_limits<uint32_t>::max();
+
+    const TransportCatalogue& cat_;
+    std::vector<TimetableTrip> trips_;
+    std::vector<TimetableConnection> connections_;
+};
+
+} // namespace catalogue
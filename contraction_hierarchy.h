@@ -0,0 +1,570 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Иерархия сжатия (Contraction Hierarchies).
+// При создании базы вершины по очереди "сжимаются": вместо вершины добавляются
+// ребра-ярлыки между ее соседями, если через нее проходит единственный кратчайший путь.
+// Запрос - двунаправленный поиск Дейкстры только по ребрам к вершинам с большим рангом;
+// найденный путь раскрывается до исходных ребер графа.
+template <typename Weight>
+class ContractionHierarchy {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+    // ребро иерархии: исходное ребро графа или ярлык из двух ребер иерархии
+    struct ChEdge {
+        VertexId from;
+        VertexId to;
+        Weight weight;
+        // EdgeId исходного графа, NO_EDGE - для ярлыка
+        EdgeId original_edge = NO_EDGE;
+        // ярлык from -> to = first_child (from -> middle) + second_child (middle -> to)
+        EdgeId first_child = NO_EDGE;
+        EdgeId second_child = NO_EDGE;
+
+        bool IsShortcut() const {
+            return original_edge == NO_EDGE;
+        }
+    };
+
+    explicit ContractionHierarchy(const Graph& graph);
+    ContractionHierarchy(const Graph& graph, std::vector<size_t>&& ranks, std::vector<ChEdge>&& edges);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // **** for serialization purposes ****
+    const std::vector<size_t>& GetRanks() const;
+    const std::vector<ChEdge>& GetEdges() const;
+
+private:
+    struct QueueEntry {
+        Weight weight;
+        VertexId vertex;
+
+        bool operator>(const QueueEntry& other) const {
+            return weight > other.weight;
+        }
+    };
+    using Queue = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>>;
+
+    // Состояние сжатия - нужно только при построении иерархии
+    struct Contraction {
+        std::vector<std::vector<EdgeId>> out_edges;
+        std::vector<std::vector<EdgeId>> in_edges;
+        std::vector<bool> contracted;
+        std::vector<int> contracted_neighbors;
+
+        // рабочие массивы поиска свидетелей
+        std::vector<std::optional<Weight>> witness_weights;
+        std::vector<VertexId> touched;
+        // концы ребер сжимаемой вершины: поиск заканчивается, когда все они найдены
+        std::vector<bool> is_target;
+        size_t target_count = 0;
+    };
+
+    void AddOriginalEdges(Contraction& contraction);
+    void ContractVertices();
+    // число ярлыков при сжатии вершины; при apply == true ярлыки добавляются
+    int ContractVertex(Contraction& contraction, VertexId vertex, bool apply);
+    int ComputePriority(Contraction& contraction, VertexId vertex);
+    void WitnessSearch(Contraction& contraction, VertexId source, VertexId skipped, Weight max_weight) const;
+    EdgeId AddEdge(Contraction& contraction, ChEdge edge);
+    // убирает из списка соседа ребра, ведущие в сжатую вершину (или из нее)
+    void RemoveContractedEdges(std::vector<EdgeId>& edges, VertexId contracted, bool by_target) const;
+
+    // поисковые графы: ребра к вершинам с большим рангом (CSR)
+    void BuildSearchGraphs();
+
+    void UnpackEdge(EdgeId ch_edge_id, std::vector<EdgeId>& edges) const;
+
+    // ограничение числа вершин в поиске свидетелей; без свидетеля добавляется ярлык
+    static constexpr size_t WITNESS_SETTLED_LIMIT = 300;
+    static constexpr Weight ZERO_WEIGHT{};
+
+    const Graph& graph_;
+    std::vector<size_t> ranks_;
+    std::vector<ChEdge> edges_;
+
+    // прямой поиск: ребра from -> to, ранг to больше; индекс - from
+    std::vector<EdgeId> upward_offsets_;
+    std::vector<EdgeId> upward_edges_;
+    // обратный поиск: ребра from -> to, ранг from больше; индекс - to
+    std::vector<EdgeId> downward_offsets_;
+    std::vector<EdgeId> downward_edges_;
+
+    // рабочие массивы запроса; метка поколения вместо очистки массивов
+    struct SearchSide {
+        std::vector<Weight> weights;
+        std::vector<EdgeId> parent_edges;
+        std::vector<uint32_t> visited_generation;
+    };
+    mutable std::mutex search_mutex_;
+    mutable SearchSide forward_;
+    mutable SearchSide backward_;
+    mutable uint32_t generation_ = 0;
+};
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph)
+    : graph_(graph)
+{
+    ContractVertices();
+    BuildSearchGraphs();
+}
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph,
+                                                   std::vector<size_t>&& ranks,
+                                                   std::vector<ChEdge>&& edges)
+    : graph_(graph)
+    , ranks_(std::move(ranks))
+    , edges_(std::move(edges))
+{
+    if (ranks_.size() != graph_.GetVertexCount()) {
+        throw std::invalid_argument("Contraction hierarchy doesn't match graph");
+    }
+    BuildSearchGraphs();
+}
+
+template <typename Weight>
+EdgeId ContractionHierarchy<Weight>::AddEdge(Contraction& contraction, ChEdge edge) {
+    const EdgeId id = edges_.size();
+    contraction.out_edges[edge.from].push_back(id);
+    contraction.in_edges[edge.to].push_back(id);
+    edges_.push_back(std::move(edge));
+    return id;
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::AddOriginalEdges(Contraction& contraction) {
+    // из параллельных ребер нужно только самое легкое (при равенстве - первое)
+    std::unordered_map<VertexId, EdgeId> best_edges;
+    for (VertexId from = 0; from < graph_.GetVertexCount(); ++from) {
+        best_edges.clear();
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(from)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (edge.weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            if (edge.to == from) {
+                continue;
+            }
+            auto [it, inserted] = best_edges.emplace(edge.to, edge_id);
+            if (!inserted && edge.weight < graph_.GetEdge(it->second).weight) {
+                it->second = edge_id;
+            }
+        }
+        std::vector<EdgeId> vertex_edges;
+        for (const auto& [to, edge_id] : best_edges) {
+            vertex_edges.push_back(edge_id);
+        }
+        std::sort(vertex_edges.begin(), vertex_edges.end());
+        for (const EdgeId edge_id : vertex_edges) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            AddEdge(contraction, ChEdge{edge.from, edge.to, edge.weight, edge_id});
+        }
+    }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::WitnessSearch(Contraction& contraction, VertexId source,
+                                                 VertexId skipped, Weight max_weight) const {
+    for (const VertexId vertex : contraction.touched) {
+        contraction.witness_weights[vertex].reset();
+    }
+    contraction.touched.clear();
+
+    Queue queue;
+    contraction.witness_weights[source] = ZERO_WEIGHT;
+    contraction.touched.push_back(source);
+    queue.push({ZERO_WEIGHT, source});
+
+    size_t settled = 0;
+    size_t targets_left = contraction.target_count;
+    while (!queue.empty() && settled < WITNESS_SETTLED_LIMIT && targets_left > 0) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > *contraction.witness_weights[vertex]) {
+            continue;
+        }
+        if (weight > max_weight) {
+            break;
+        }
+        ++settled;
+        if (contraction.is_target[vertex]) {
+            --targets_left;
+        }
+        for (const EdgeId edge_id : contraction.out_edges[vertex]) {
+            const ChEdge& edge = edges_[edge_id];
+            if (edge.to == skipped || contraction.contracted[edge.to]) {
+                continue;
+            }
+            const Weight candidate = weight + edge.weight;
+            auto& to_weight = contraction.witness_weights[edge.to];
+            if (!to_weight || candidate < *to_weight) {
+                if (!to_weight) {
+                    contraction.touched.push_back(edge.to);
+                }
+                to_weight = candidate;
+                queue.push({candidate, edge.to});
+            }
+        }
+    }
+}
+
+template <typename Weight>
+int ContractionHierarchy<Weight>::ContractVertex(Contraction& contraction, VertexId vertex, bool apply) {
+    std::vector<EdgeId> in_edges;
+    for (const EdgeId edge_id : contraction.in_edges[vertex]) {
+        if (!contraction.contracted[edges_[edge_id].from]) {
+            in_edges.push_back(edge_id);
+        }
+    }
+    std::vector<EdgeId> out_edges;
+    for (const EdgeId edge_id : contraction.out_edges[vertex]) {
+        if (!contraction.contracted[edges_[edge_id].to]) {
+            out_edges.push_back(edge_id);
+        }
+    }
+
+    // Свидетель возможен, только если в конец ребра входит еще какое-то ребро.
+    // В графе маршрутов это часто не так (в "исходящую" вершину остановки входит
+    // только ребро ожидания), и тогда поиск не нужен.
+    for (const EdgeId out_edge_id : out_edges) {
+        const VertexId to = edges_[out_edge_id].to;
+        if (contraction.is_target[to]) {
+            continue;
+        }
+        for (const EdgeId edge_id : contraction.in_edges[to]) {
+            if (edges_[edge_id].from != vertex) {
+                contraction.is_target[to] = true;
+                ++contraction.target_count;
+                break;
+            }
+        }
+    }
+
+    int shortcuts = 0;
+    for (const EdgeId in_edge_id : in_edges) {
+        const VertexId from = edges_[in_edge_id].from;
+        const Weight in_weight = edges_[in_edge_id].weight;
+
+        std::optional<Weight> max_weight;
+        for (const EdgeId out_edge_id : out_edges) {
+            if (edges_[out_edge_id].to == from) {
+                continue;
+            }
+            const Weight candidate = in_weight + edges_[out_edge_id].weight;
+            if (!max_weight || *max_weight < candidate) {
+                max_weight = candidate;
+            }
+        }
+        if (!max_weight) {
+            continue;
+        }
+
+        if (contraction.target_count > 0) {
+            WitnessSearch(contraction, from, vertex, *max_weight);
+        }
+
+        for (const EdgeId out_edge_id : out_edges) {
+            const VertexId to = edges_[out_edge_id].to;
+            if (to == from) {
+                continue;
+            }
+            const Weight candidate = in_weight + edges_[out_edge_id].weight;
+            const auto& witness = contraction.witness_weights[to];
+            if (contraction.is_target[to] && witness && *witness <= candidate) {
+                continue;
+            }
+            ++shortcuts;
+            if (apply) {
+                AddEdge(contraction, ChEdge{from, to, candidate, NO_EDGE, in_edge_id, out_edge_id});
+            }
+        }
+    }
+
+    for (const EdgeId out_edge_id : out_edges) {
+        contraction.is_target[edges_[out_edge_id].to] = false;
+    }
+    contraction.target_count = 0;
+    return shortcuts;
+}
+
+template <typename Weight>
+int ContractionHierarchy<Weight>::ComputePriority(Contraction& contraction, VertexId vertex) {
+    int live_edges = 0;
+    for (const EdgeId edge_id : contraction.in_edges[vertex]) {
+        live_edges += contraction.contracted[edges_[edge_id].from] ? 0 : 1;
+    }
+    for (const EdgeId edge_id : contraction.out_edges[vertex]) {
+        live_edges += contraction.contracted[edges_[edge_id].to] ? 0 : 1;
+    }
+    // разность ребер + число уже сжатых соседей (равномерность сжатия)
+    return ContractVertex(contraction, vertex, false) - live_edges + contraction.contracted_neighbors[vertex];
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::RemoveContractedEdges(std::vector<EdgeId>& edges, VertexId contracted,
+                                                         bool by_target) const {
+    edges.erase(std::remove_if(edges.begin(), edges.end(), [&](EdgeId edge_id) {
+        return (by_target ? edges_[edge_id].to : edges_[edge_id].from) == contracted;
+    }), edges.end());
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::ContractVertices() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    Contraction contraction{
+        std::vector<std::vector<EdgeId>>(vertex_count),
+        std::vector<std::vector<EdgeId>>(vertex_count),
+        std::vector<bool>(vertex_count, false),
+        std::vector<int>(vertex_count, 0),
+        std::vector<std::optional<Weight>>(vertex_count),
+        {},
+        std::vector<bool>(vertex_count, false)
+    };
+    AddOriginalEdges(contraction);
+
+    using PriorityEntry = std::pair<int, VertexId>;
+    std::priority_queue<PriorityEntry, std::vector<PriorityEntry>, std::greater<PriorityEntry>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        queue.push({ComputePriority(contraction, vertex), vertex});
+    }
+
+    ranks_.assign(vertex_count, 0);
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+        if (contraction.contracted[vertex]) {
+            continue;
+        }
+        // ленивое обновление: приоритет мог вырасти после сжатия соседей
+        const int priority = ComputePriority(contraction, vertex);
+        if (!queue.empty() && priority > queue.top().first) {
+            queue.push({priority, vertex});
+            continue;
+        }
+
+        ContractVertex(contraction, vertex, true);
+        contraction.contracted[vertex] = true;
+        ranks_[vertex] = next_rank++;
+
+        // ребра сжатой вершины больше не участвуют в сжатии соседей
+        for (const EdgeId edge_id : contraction.in_edges[vertex]) {
+            const VertexId neighbor = edges_[edge_id].from;
+            if (!contraction.contracted[neighbor]) {
+                ++contraction.contracted_neighbors[neighbor];
+                RemoveContractedEdges(contraction.out_edges[neighbor], vertex, true);
+            }
+        }
+        for (const EdgeId edge_id : contraction.out_edges[vertex]) {
+            const VertexId neighbor = edges_[edge_id].to;
+            if (!contraction.contracted[neighbor]) {
+                ++contraction.contracted_neighbors[neighbor];
+                RemoveContractedEdges(contraction.in_edges[neighbor], vertex, false);
+            }
+        }
+        std::vector<EdgeId>().swap(contraction.in_edges[vertex]);
+        std::vector<EdgeId>().swap(contraction.out_edges[vertex]);
+    }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::BuildSearchGraphs() {
+    const size_t vertex_count = ranks_.size();
+    upward_offsets_.assign(vertex_count + 1, 0);
+    downward_offsets_.assign(vertex_count + 1, 0);
+    for (const ChEdge& edge : edges_) {
+        if (edge.from >= vertex_count || edge.to >= vertex_count) {
+            throw std::invalid_argument("Bad contraction hierarchy edge");
+        }
+        if (ranks_[edge.from] < ranks_[edge.to]) {
+            ++upward_offsets_[edge.from + 1];
+        } else if (ranks_[edge.from] > ranks_[edge.to]) {
+            ++downward_offsets_[edge.to + 1];
+        }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        upward_offsets_[vertex + 1] += upward_offsets_[vertex];
+        downward_offsets_[vertex + 1] += downward_offsets_[vertex];
+    }
+
+    upward_edges_.resize(upward_offsets_.back());
+    downward_edges_.resize(downward_offsets_.back());
+    std::vector<EdgeId> upward_fill(upward_offsets_.begin(), upward_offsets_.end() - 1);
+    std::vector<EdgeId> downward_fill(downward_offsets_.begin(), downward_offsets_.end() - 1);
+    for (EdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+        const ChEdge& edge = edges_[edge_id];
+        if (ranks_[edge.from] < ranks_[edge.to]) {
+            upward_edges_[upward_fill[edge.from]++] = edge_id;
+        } else if (ranks_[edge.from] > ranks_[edge.to]) {
+            downward_edges_[downward_fill[edge.to]++] = edge_id;
+        }
+    }
+
+    for (SearchSide* side : {&forward_, &backward_}) {
+        side->weights.assign(vertex_count, ZERO_WEIGHT);
+        side->parent_edges.assign(vertex_count, NO_EDGE);
+        side->visited_generation.assign(vertex_count, 0);
+    }
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::RouteInfo>
+ContractionHierarchy<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    if (from >= ranks_.size() || to >= ranks_.size()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}};
+    }
+
+    std::lock_guard guard(search_mutex_);
+    if (++generation_ == 0) {
+        // переполнение счетчика поколений - сбрасываем метки
+        for (SearchSide* side : {&forward_, &backward_}) {
+            std::fill(side->visited_generation.begin(), side->visited_generation.end(), 0);
+        }
+        generation_ = 1;
+    }
+
+    auto is_visited = [this](const SearchSide& side, VertexId vertex) {
+        return side.visited_generation[vertex] == generation_;
+    };
+
+    Queue forward_queue;
+    Queue backward_queue;
+    forward_.visited_generation[from] = generation_;
+    forward_.weights[from] = ZERO_WEIGHT;
+    forward_.parent_edges[from] = NO_EDGE;
+    forward_queue.push({ZERO_WEIGHT, from});
+    backward_.visited_generation[to] = generation_;
+    backward_.weights[to] = ZERO_WEIGHT;
+    backward_.parent_edges[to] = NO_EDGE;
+    backward_queue.push({ZERO_WEIGHT, to});
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = 0;
+
+    auto is_done = [&best_weight](const Queue& queue) {
+        return queue.empty() || (best_weight && queue.top().weight >= *best_weight);
+    };
+
+    bool forward_turn = true;
+    while (!is_done(forward_queue) || !is_done(backward_queue)) {
+        if (is_done(forward_queue)) {
+            forward_turn = false;
+        } else if (is_done(backward_queue)) {
+            forward_turn = true;
+        }
+
+        const bool forward = forward_turn;
+        forward_turn = !forward_turn;
+        SearchSide& side = forward ? forward_ : backward_;
+        const SearchSide& other_side = forward ? backward_ : forward_;
+        Queue& queue = forward ? forward_queue : backward_queue;
+
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (side.weights[vertex] < weight) {
+            continue;
+        }
+
+        if (is_visited(other_side, vertex)) {
+            const Weight candidate = weight + other_side.weights[vertex];
+            if (!best_weight || candidate < *best_weight) {
+                best_weight = candidate;
+                meeting_vertex = vertex;
+            }
+        }
+
+        const std::vector<EdgeId>& offsets = forward ? upward_offsets_ : downward_offsets_;
+        const std::vector<EdgeId>& search_edges = forward ? upward_edges_ : downward_edges_;
+        for (EdgeId index = offsets[vertex]; index < offsets[vertex + 1]; ++index) {
+            const EdgeId edge_id = search_edges[index];
+            const ChEdge& edge = edges_[edge_id];
+            const VertexId next = forward ? edge.to : edge.from;
+            const Weight candidate = weight + edge.weight;
+            if (!is_visited(side, next) || candidate < side.weights[next]) {
+                side.visited_generation[next] = generation_;
+                side.weights[next] = candidate;
+                side.parent_edges[next] = edge_id;
+                queue.push({candidate, next});
+            }
+        }
+    }
+
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    // ребра иерархии: from -> meeting_vertex, затем meeting_vertex -> to
+    std::vector<EdgeId> ch_edges;
+    for (VertexId vertex = meeting_vertex; forward_.parent_edges[vertex] != NO_EDGE;
+         vertex = edges_[forward_.parent_edges[vertex]].from) {
+        ch_edges.push_back(forward_.parent_edges[vertex]);
+    }
+    std::reverse(ch_edges.begin(), ch_edges.end());
+    for (VertexId vertex = meeting_vertex; backward_.parent_edges[vertex] != NO_EDGE;
+         vertex = edges_[backward_.parent_edges[vertex]].to) {
+        ch_edges.push_back(backward_.parent_edges[vertex]);
+    }
+
+    std::vector<EdgeId> edges;
+    for (const EdgeId ch_edge_id : ch_edges) {
+        UnpackEdge(ch_edge_id, edges);
+    }
+    return RouteInfo{*best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::UnpackEdge(EdgeId ch_edge_id, std::vector<EdgeId>& edges) const {
+    std::vector<EdgeId> stack{ch_edge_id};
+    while (!stack.empty()) {
+        const ChEdge& edge = edges_[stack.back()];
+        stack.pop_back();
+        if (edge.IsShortcut()) {
+            // второе ребро кладется первым, чтобы первое раскрылось раньше
+            stack.push_back(edge.second_child);
+            stack.push_back(edge.first_child);
+        } else {
+            edges.push_back(edge.original_edge);
+        }
+    }
+}
+
+template <typename Weight>
+const std::vector<size_t>& ContractionHierarchy<Weight>::GetRanks() const {
+    return ranks_;
+}
+
+template <typename Weight>
+const std::vector<typename ContractionHierarchy<Weight>::ChEdge>&
+ContractionHierarchy<Weight>::GetEdges() const {
+    return edges_;
+}
+
+}  // namespace graph
@@ -0,0 +1,469 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Настраиваемая иерархия сжатия (Customizable Contraction Hierarchies).
+// Построение разделено на две части:
+//  - не зависящая от весов: порядок сжатия вершин (минимальная степень) и дуги между
+//    вершиной и ее соседями большего ранга, включая дуги-ярлыки, добавленные при сжатии.
+//    Ярлык добавляется всегда, без поиска свидетелей, поэтому дуги годятся для любых весов;
+//  - настройка (Customize) под конкретные веса ребер: веса дуг в обе стороны считаются
+//    по нижним треугольникам за один проход по вершинам в порядке ранга.
+// Запрос - подъем от обеих вершин по дереву исключения (родитель - сосед наименьшего
+// большего ранга): в него входят все вершины, достижимые по дугам вверх.
+template <typename Weight>
+class CustomizableContractionHierarchy {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    static constexpr uint32_t NO_ID = std::numeric_limits<uint32_t>::max();
+
+    // вес дуги в одну сторону при одних весах ребер
+    struct ArcWeight {
+        Weight weight{};
+        // исходное ребро графа, NO_ID - ярлык или нет пути
+        EdgeId edge = NO_ID;
+        // ярлык через вершину меньшего ранга (ранг), NO_ID - исходное ребро или нет пути
+        uint32_t middle = NO_ID;
+
+        bool HasPath() const {
+            return edge != NO_ID || middle != NO_ID;
+        }
+    };
+
+    // веса дуг при одних весах ребер (профиль); индекс - номер дуги
+    struct Metric {
+        // от вершины меньшего ранга к вершине большего
+        std::vector<ArcWeight> upward;
+        // от вершины большего ранга к вершине меньшего
+        std::vector<ArcWeight> downward;
+    };
+
+    explicit CustomizableContractionHierarchy(const Graph& graph);
+    // загруженные из базы порядок и дуги
+    CustomizableContractionHierarchy(const Graph& graph, std::vector<VertexId>&& order,
+                                     std::vector<uint32_t>&& arc_offsets, std::vector<uint32_t>&& arc_heads);
+
+    // edge_weights[EdgeId] - веса всех ребер графа
+    Metric Customize(const std::vector<Weight>& edge_weights) const;
+
+    std::optional<RouteInfo> BuildRoute(const Metric& metric, VertexId from, VertexId to) const;
+
+    // **** for serialization purposes ****
+    // index = ранг, значение - VertexId
+    const std::vector<VertexId>& GetOrder() const;
+    // дуги вершины ранга r - [arc_offsets[r], arc_offsets[r + 1]), по возрастанию ранга конца
+    const std::vector<uint32_t>& GetArcOffsets() const;
+    const std::vector<uint32_t>& GetArcHeads() const;
+
+private:
+    void ComputeOrder();
+    void IndexArcs();
+    uint32_t FindArc(uint32_t lower, uint32_t upper) const;
+    void UnpackArc(uint32_t arc, bool upward, const Metric& metric, std::vector<EdgeId>& edges) const;
+
+    const Graph& graph_;
+
+    std::vector<VertexId> order_;
+    // index = VertexId
+    std::vector<uint32_t> ranks_;
+    // дуги по рангу меньшей вершины (CSR), концы - ранги
+    std::vector<uint32_t> arc_offsets_;
+    std::vector<uint32_t> arc_heads_;
+    std::vector<uint32_t> arc_tails_;
+    // дуги к вершине от вершин меньшего ранга (CSR по рангу конца) - для настройки
+    std::vector<uint32_t> down_arc_offsets_;
+    std::vector<uint32_t> down_arcs_;
+    // дерево исключения, NO_ID - корень
+    std::vector<uint32_t> parents_;
+
+    // рабочие массивы запроса (индекс - ранг), после запроса сбрасываются
+    // только затронутые элементы
+    struct SearchSide {
+        std::vector<Weight> weights;
+        std::vector<uint32_t> parent_arcs;
+        std::vector<bool> reached;
+    };
+    mutable std::mutex search_mutex_;
+    mutable SearchSide forward_;
+    mutable SearchSide backward_;
+};
+
+template <typename Weight>
+CustomizableContractionHierarchy<Weight>::CustomizableContractionHierarchy(const Graph& graph)
+    : graph_(graph)
+{
+    ComputeOrder();
+    IndexArcs();
+}
+
+template <typename Weight>
+CustomizableContractionHierarchy<Weight>::CustomizableContractionHierarchy(
+    const Graph& graph, std::vector<VertexId>&& order,
+    std::vector<uint32_t>&& arc_offsets, std::vector<uint32_t>&& arc_heads)
+    : graph_(graph)
+    , order_(std::move(order))
+    , arc_offsets_(std::move(arc_offsets))
+    , arc_heads_(std::move(arc_heads))
+{
+    if (order_.size() != graph_.GetVertexCount() || arc_offsets_.size() != order_.size() + 1
+        || arc_offsets_.back() != arc_heads_.size()) {
+        throw std::logic_error("Customizable contraction hierarchy doesn't match route graph");
+    }
+    IndexArcs();
+}
+
+template <typename Weight>
+void CustomizableContractionHierarchy<Weight>::ComputeOrder() {
+    const size_t vertex_count = graph_.GetVertexCount();
+
+    // соседи без учета направления ребер, по возрастанию
+    std::vector<std::vector<uint32_t>> neighbors(vertex_count);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const Edge<Weight>& edge = graph_.GetEdge(edge_id);
+        if (edge.from != edge.to) {
+            neighbors[edge.from].push_back(static_cast<uint32_t>(edge.to));
+            neighbors[edge.to].push_back(static_cast<uint32_t>(edge.from));
+        }
+    }
+    for (std::vector<uint32_t>& vertex_neighbors : neighbors) {
+        std::sort(vertex_neighbors.begin(), vertex_neighbors.end());
+        vertex_neighbors.erase(std::unique(vertex_neighbors.begin(), vertex_neighbors.end()), vertex_neighbors.end());
+    }
+
+    // сжимается вершина наименьшей текущей степени (при равенстве - с меньшим номером),
+    // ее соседи попарно соединяются
+    using QueueEntry = std::pair<size_t, uint32_t>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    for (uint32_t vertex = 0; vertex < vertex_count; ++vertex) {
+        queue.push({neighbors[vertex].size(), vertex});
+    }
+    std::vector<bool> contracted(vertex_count, false);
+    std::vector<std::vector<uint32_t>> upper_neighbors(vertex_count);
+    order_.clear();
+    order_.reserve(vertex_count);
+    std::vector<uint32_t> merged;
+    while (!queue.empty()) {
+        const auto [degree, vertex] = queue.top();
+        queue.pop();
+        if (contracted[vertex] || degree != neighbors[vertex].size()) {
+            continue;
+        }
+        contracted[vertex] = true;
+        order_.push_back(vertex);
+        const std::vector<uint32_t>& clique = neighbors[vertex];
+        for (const uint32_t neighbor : clique) {
+            std::vector<uint32_t>& neighbor_list = neighbors[neighbor];
+            merged.clear();
+            std::set_union(neighbor_list.begin(), neighbor_list.end(), clique.begin(), clique.end(),
+                           std::back_inserter(merged));
+            merged.erase(std::remove_if(merged.begin(), merged.end(), [neighbor, vertex](uint32_t other) {
+                return other == neighbor || other == vertex;
+            }), merged.end());
+            if (merged.size() != neighbor_list.size()) {
+                queue.push({merged.size(), neighbor});
+            }
+            neighbor_list.swap(merged);
+        }
+        upper_neighbors[vertex] = std::move(neighbors[vertex]);
+        neighbors[vertex].clear();
+    }
+
+    ranks_.assign(vertex_count, 0);
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        ranks_[order_[rank]] = rank;
+    }
+    arc_offsets_.assign(1, 0);
+    arc_heads_.clear();
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        std::vector<uint32_t> heads;
+        heads.reserve(upper_neighbors[order_[rank]].size());
+        for (const uint32_t neighbor : upper_neighbors[order_[rank]]) {
+            heads.push_back(ranks_[neighbor]);
+        }
+        std::sort(heads.begin(), heads.end());
+        arc_heads_.insert(arc_heads_.end(), heads.begin(), heads.end());
+        arc_offsets_.push_back(static_cast<uint32_t>(arc_heads_.size()));
+    }
+}
+
+template <typename Weight>
+void CustomizableContractionHierarchy<Weight>::IndexArcs() {
+    const size_t vertex_count = order_.size();
+    ranks_.assign(vertex_count, 0);
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        ranks_[order_[rank]] = rank;
+    }
+    arc_tails_.resize(arc_heads_.size());
+    parents_.assign(vertex_count, NO_ID);
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        for (uint32_t arc = arc_offsets_[rank]; arc < arc_offsets_[rank + 1]; ++arc) {
+            if (arc_heads_[arc] <= rank || arc_heads_[arc] >= vertex_count) {
+                throw std::logic_error("Bad customizable contraction hierarchy arc");
+            }
+            arc_tails_[arc] = rank;
+        }
+        if (arc_offsets_[rank] != arc_offsets_[rank + 1]) {
+            parents_[rank] = arc_heads_[arc_offsets_[rank]];
+        }
+    }
+    down_arc_offsets_.assign(vertex_count + 1, 0);
+    for (const uint32_t head : arc_heads_) {
+        ++down_arc_offsets_[head + 1];
+    }
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        down_arc_offsets_[rank + 1] += down_arc_offsets_[rank];
+    }
+    down_arcs_.resize(arc_heads_.size());
+    std::vector<uint32_t> fill(down_arc_offsets_.begin(), down_arc_offsets_.end() - 1);
+    for (uint32_t arc = 0; arc < arc_heads_.size(); ++arc) {
+        down_arcs_[fill[arc_heads_[arc]]++] = arc;
+    }
+
+    forward_.weights.assign(vertex_count, Weight{});
+    forward_.parent_arcs.assign(vertex_count, NO_ID);
+    forward_.reached.assign(vertex_count, false);
+    backward_ = forward_;
+}
+
+template <typename Weight>
+uint32_t CustomizableContractionHierarchy<Weight>::FindArc(uint32_t lower, uint32_t upper) const {
+    const auto begin = arc_heads_.begin() + arc_offsets_[lower];
+    const auto end = arc_heads_.begin() + arc_offsets_[lower + 1];
+    const auto it = std::lower_bound(begin, end, upper);
+    if (it == end || *it != upper) {
+        throw std::logic_error("Missing customizable contraction hierarchy arc");
+    }
+    return static_cast<uint32_t>(it - arc_heads_.begin());
+}
+
+template <typename Weight>
+typename CustomizableContractionHierarchy<Weight>::Metric
+CustomizableContractionHierarchy<Weight>::Customize(const std::vector<Weight>& edge_weights) const {
+    if (edge_weights.size() != graph_.GetEdgeCount()) {
+        throw std::logic_error("Edge weights don't match route graph");
+    }
+    Metric metric;
+    metric.upward.resize(arc_heads_.size());
+    metric.downward.resize(arc_heads_.size());
+
+    // исходные ребра: из параллельных - самое легкое, при равенстве - с меньшим EdgeId
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const Edge<Weight>& edge = graph_.GetEdge(edge_id);
+        if (edge.from == edge.to) {
+            continue;
+        }
+        const uint32_t from_rank = ranks_[edge.from];
+        const uint32_t to_rank = ranks_[edge.to];
+        const uint32_t arc = from_rank < to_rank ? FindArc(from_rank, to_rank) : FindArc(to_rank, from_rank);
+        ArcWeight& arc_weight = from_rank < to_rank ? metric.upward[arc] : metric.downward[arc];
+        if (!arc_weight.HasPath() || edge_weights[edge_id] < arc_weight.weight) {
+            arc_weight = {edge_weights[edge_id], edge_id, NO_ID};
+        }
+    }
+
+    // нижние треугольники дуг вершины lower: вершины middle ниже нее с дугами middle -> lower
+    // и middle -> upper. Дуги middle окончательны - они обработаны раньше (middle < lower)
+    std::vector<uint32_t> upper_arcs(order_.size(), NO_ID);
+    for (uint32_t lower = 0; lower < order_.size(); ++lower) {
+        for (uint32_t arc = arc_offsets_[lower]; arc < arc_offsets_[lower + 1]; ++arc) {
+            upper_arcs[arc_heads_[arc]] = arc;
+        }
+        for (uint32_t index = down_arc_offsets_[lower]; index < down_arc_offsets_[lower + 1]; ++index) {
+            const uint32_t low_arc = down_arcs_[index];
+            const uint32_t middle = arc_tails_[low_arc];
+            // дуги middle упорядочены по концу: дальше low_arc - к вершинам выше lower
+            for (uint32_t high_arc = low_arc + 1; high_arc < arc_offsets_[middle + 1]; ++high_arc) {
+                const uint32_t arc = upper_arcs[arc_heads_[high_arc]];
+                // lower -> middle -> upper и обратно
+                const ArcWeight& low_down = metric.downward[low_arc];
+                const ArcWeight& high_up = metric.upward[high_arc];
+                if (low_down.HasPath() && high_up.HasPath()) {
+                    const Weight candidate = low_down.weight + high_up.weight;
+                    if (!metric.upward[arc].HasPath() || candidate < metric.upward[arc].weight) {
+                        metric.upward[arc] = {candidate, NO_ID, middle};
+                    }
+                }
+                const ArcWeight& high_down = metric.downward[high_arc];
+                const ArcWeight& low_up = metric.upward[low_arc];
+                if (high_down.HasPath() && low_up.HasPath()) {
+                    const Weight candidate = high_down.weight + low_up.weight;
+                    if (!metric.downward[arc].HasPath() || candidate < metric.downward[arc].weight) {
+                        metric.downward[arc] = {candidate, NO_ID, middle};
+                    }
+                }
+            }
+        }
+        for (uint32_t arc = arc_offsets_[lower]; arc < arc_offsets_[lower + 1]; ++arc) {
+            upper_arcs[arc_heads_[arc]] = NO_ID;
+        }
+    }
+    return metric;
+}
+
+template <typename Weight>
+std::optional<typename CustomizableContractionHierarchy<Weight>::RouteInfo>
+CustomizableContractionHierarchy<Weight>::BuildRoute(const Metric& metric, VertexId from, VertexId to) const {
+    if (from >= ranks_.size() || to >= ranks_.size()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    if (from == to) {
+        return RouteInfo{Weight{}, {}};
+    }
+
+    std::lock_guard guard(search_mutex_);
+
+    auto relax = [this](SearchSide& side, const std::vector<ArcWeight>& arc_weights, uint32_t rank) {
+        for (uint32_t arc = arc_offsets_[rank]; arc < arc_offsets_[rank + 1]; ++arc) {
+            if (!arc_weights[arc].HasPath()) {
+                continue;
+            }
+            const uint32_t head = arc_heads_[arc];
+            const Weight candidate = side.weights[rank] + arc_weights[arc].weight;
+            if (!side.reached[head] || candidate < side.weights[head]) {
+                side.reached[head] = true;
+                side.weights[head] = candidate;
+                side.parent_arcs[head] = arc;
+            }
+        }
+    };
+    // подъем по дереву исключения до вершины stop: ранги возрастают, каждая вершина
+    // раскрывается один раз. Концы дуг вершин пути лежат на этом же пути
+    auto climb = [this, &relax](SearchSide& side, const std::vector<ArcWeight>& arc_weights,
+                                uint32_t source, uint32_t stop) {
+        std::vector<uint32_t> path;
+        side.weights[source] = Weight{};
+        side.reached[source] = true;
+        for (uint32_t rank = source; rank != stop; rank = parents_[rank]) {
+            path.push_back(rank);
+            if (side.reached[rank]) {
+                relax(side, arc_weights, rank);
+            }
+        }
+        return path;
+    };
+
+    // общий предок; NO_ID - вершины в разных деревьях, пути между ними нет
+    uint32_t common = ranks_[from];
+    uint32_t other = ranks_[to];
+    while (common != other && common != NO_ID && other != NO_ID) {
+        if (common < other) {
+            common = parents_[common];
+        } else {
+            other = parents_[other];
+        }
+    }
+    if (common != other) {
+        common = NO_ID;
+    }
+    std::vector<uint32_t> forward_path = climb(forward_, metric.upward, ranks_[from], common);
+    std::vector<uint32_t> backward_path = climb(backward_, metric.downward, ranks_[to], common);
+
+    // встреча возможна только на общей части путей к корню; вершины, до которых
+    // не быстрее уже найденного пути, не раскрываются
+    std::optional<Weight> best_weight;
+    uint32_t meeting_rank = NO_ID;
+    for (uint32_t rank = common; rank != NO_ID; rank = parents_[rank]) {
+        forward_path.push_back(rank);
+        backward_path.push_back(rank);
+        if (forward_.reached[rank] && backward_.reached[rank]) {
+            const Weight candidate = forward_.weights[rank] + backward_.weights[rank];
+            if (!best_weight || candidate < *best_weight) {
+                best_weight = candidate;
+                meeting_rank = rank;
+            }
+        }
+        if (forward_.reached[rank] && (!best_weight || forward_.weights[rank] < *best_weight)) {
+            relax(forward_, metric.upward, rank);
+        }
+        if (backward_.reached[rank] && (!best_weight || backward_.weights[rank] < *best_weight)) {
+            relax(backward_, metric.downward, rank);
+        }
+    }
+
+    std::optional<RouteInfo> result;
+    if (best_weight) {
+        std::vector<std::pair<uint32_t, bool>> arcs;
+        for (uint32_t rank = meeting_rank; forward_.parent_arcs[rank] != NO_ID; rank = arc_tails_[forward_.parent_arcs[rank]]) {
+            arcs.push_back({forward_.parent_arcs[rank], true});
+        }
+        std::reverse(arcs.begin(), arcs.end());
+        for (uint32_t rank = meeting_rank; backward_.parent_arcs[rank] != NO_ID; rank = arc_tails_[backward_.parent_arcs[rank]]) {
+            arcs.push_back({backward_.parent_arcs[rank], false});
+        }
+        std::vector<EdgeId> edges;
+        for (const auto& [arc, upward] : arcs) {
+            UnpackArc(arc, upward, metric, edges);
+        }
+        result = RouteInfo{*best_weight, std::move(edges)};
+    }
+
+    for (SearchSide* side : {&forward_, &backward_}) {
+        for (const uint32_t rank : side == &forward_ ? forward_path : backward_path) {
+            side->reached[rank] = false;
+            side->parent_arcs[rank] = NO_ID;
+        }
+    }
+    return result;
+}
+
+template <typename Weight>
+void CustomizableContractionHierarchy<Weight>::UnpackArc(uint32_t arc, bool upward, const Metric& metric,
+                                                         std::vector<EdgeId>& edges) const {
+    std::vector<std::pair<uint32_t, bool>> stack{{arc, upward}};
+    while (!stack.empty()) {
+        const auto [current, current_upward] = stack.back();
+        stack.pop_back();
+        const ArcWeight& arc_weight = current_upward ? metric.upward[current] : metric.downward[current];
+        if (arc_weight.edge != NO_ID) {
+            edges.push_back(arc_weight.edge);
+            continue;
+        }
+        const uint32_t low_arc = FindArc(arc_weight.middle, arc_tails_[current]);
+        const uint32_t high_arc = FindArc(arc_weight.middle, arc_heads_[current]);
+        // вверх: low -> middle -> high, вниз: high -> middle -> low;
+        // второе ребро кладется первым, чтобы первое раскрылось раньше
+        if (current_upward) {
+            stack.push_back({high_arc, true});
+            stack.push_back({low_arc, false});
+        } else {
+            stack.push_back({low_arc, true});
+            stack.push_back({high_arc, false});
+        }
+    }
+}
+
+template <typename Weight>
+const std::vector<VertexId>& CustomizableContractionHierarchy<Weight>::GetOrder() const {
+    return order_;
+}
+
+template <typename Weight>
+const std::vector<uint32_t>& CustomizableContractionHierarchy<Weight>::GetArcOffsets() const {
+    return arc_offsets_;
+}
+
+template <typename Weight>
+const std::vector<uint32_t>& CustomizableContractionHierarchy<Weight>::GetArcHeads() const {
+    return arc_heads_;
+}
+
+}  // namespace graph
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Маршрутизатор без предварительного расчета: на каждый запрос запускается
+// алгоритм Дейкстры на двоичной куче из вершины отправления.
+// Деревья кратчайших путей кешируются по вершине-источнику (LRU).
+template <typename Weight>
+class DijkstraRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using RouteInternalData = typename Router<Weight>::RouteInternalData;
+    // index = VertexId назначения
+    using ShortestPathTree = std::vector<std::optional<RouteInternalData>>;
+
+    static constexpr size_t DEFAULT_CACHE_CAPACITY = 256;
+
+    explicit DijkstraRouter(const Graph& graph, size_t cache_capacity = DEFAULT_CACHE_CAPACITY);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    // маршрут до to по уже полученному дереву - для запросов из одной вершины во многие
+    std::optional<RouteInfo> BuildRoute(const ShortestPathTree& tree, VertexId to) const;
+
+    // дерево кратчайших путей из вершины from (из кеша или рассчитанное)
+    std::shared_ptr<const ShortestPathTree> GetShortestPathTree(VertexId from) const;
+
+    // вершины с весом пути из from не больше max_weight - по возрастанию веса.
+    // Поиск останавливается на первой вершине дальше границы, дерево в кеш не попадает.
+    std::vector<std::pair<VertexId, Weight>> GetReachableVertices(VertexId from, const Weight& max_weight) const;
+
+private:
+    struct QueueEntry {
+        Weight weight;
+        VertexId vertex;
+
+        bool operator>(const QueueEntry& other) const {
+            return weight > other.weight;
+        }
+    };
+
+    ShortestPathTree BuildShortestPathTree(VertexId from) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+    const size_t cache_capacity_;
+
+    // в начале списка - последний использованный источник
+    using LruList = std::list<VertexId>;
+    struct CacheEntry {
+        typename LruList::iterator lru_position;
+        std::shared_ptr<const ShortestPathTree> tree;
+    };
+    mutable std::mutex cache_mutex_;
+    mutable LruList lru_;
+    mutable std::unordered_map<VertexId, CacheEntry> cache_;
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph, size_t cache_capacity)
+    : graph_(graph)
+    , cache_capacity_(cache_capacity) {
+}
+
+template <typename Weight>
+typename DijkstraRouter<Weight>::ShortestPathTree
+DijkstraRouter<Weight>::BuildShortestPathTree(VertexId from) const {
+    ShortestPathTree tree(graph_.GetVertexCount());
+    std::vector<bool> settled(graph_.GetVertexCount(), false);
+
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    tree.at(from) = RouteInternalData{ZERO_WEIGHT, std::nullopt};
+    queue.push({ZERO_WEIGHT, from});
+
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().vertex;
+        queue.pop();
+        // в очереди могут остаться устаревшие записи вершины
+        if (settled[vertex]) {
+            continue;
+        }
+        settled[vertex] = true;
+
+        const Weight vertex_weight = tree[vertex]->weight;
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (edge.weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            auto& route_to = tree[edge.to];
+            const Weight candidate_weight = vertex_weight + edge.weight;
+            if (!route_to || candidate_weight < route_to->weight) {
+                route_to = RouteInternalData{candidate_weight, edge_id};
+                queue.push({candidate_weight, edge.to});
+            }
+        }
+    }
+    return tree;
+}
+
+template <typename Weight>
+std::shared_ptr<const typename DijkstraRouter<Weight>::ShortestPathTree>
+DijkstraRouter<Weight>::GetShortestPathTree(VertexId from) const {
+    {
+        std::lock_guard guard(cache_mutex_);
+        if (auto it = cache_.find(from); it != cache_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+            return it->second.tree;
+        }
+    }
+
+    // расчет вне блокировки - дерево строится только по константному графу
+    auto tree = std::make_shared<const ShortestPathTree>(BuildShortestPathTree(from));
+    if (cache_capacity_ == 0) {
+        return tree;
+    }
+
+    std::lock_guard guard(cache_mutex_);
+    if (cache_.count(from) == 0) {
+        if (cache_.size() >= cache_capacity_) {
+            cache_.erase(lru_.back());
+            lru_.pop_back();
+        }
+        lru_.push_front(from);
+        cache_.emplace(from, CacheEntry{lru_.begin(), tree});
+    }
+    return tree;
+}
+
+template <typename Weight>
+std::vector<std::pair<VertexId, Weight>>
+DijkstraRouter<Weight>::GetReachableVertices(VertexId from, const Weight& max_weight) const {
+    if (from >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    std::vector<std::optional<Weight>> weights(graph_.GetVertexCount());
+    std::vector<bool> settled(graph_.GetVertexCount(), false);
+    std::vector<std::pair<VertexId, Weight>> result;
+
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    weights[from] = ZERO_WEIGHT;
+    queue.push({ZERO_WEIGHT, from});
+
+    while (!queue.empty()) {
+        const auto [vertex_weight, vertex] = queue.top();
+        queue.pop();
+        if (settled[vertex]) {
+            continue;
+        }
+        // остальные вершины в очереди не ближе этой
+        if (max_weight < vertex_weight) {
+            break;
+        }
+        settled[vertex] = true;
+        result.emplace_back(vertex, vertex_weight);
+
+        for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            if (edge.weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+            auto& weight_to = weights[edge.to];
+            const Weight candidate_weight = vertex_weight + edge.weight;
+            if (!weight_to || candidate_weight < *weight_to) {
+                weight_to = candidate_weight;
+                queue.push({candidate_weight, edge.to});
+            }
+        }
+    }
+    return result;
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo>
+DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    if (from >= graph_.GetVertexCount() || to >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    const std::shared_ptr<const ShortestPathTree> tree = GetShortestPathTree(from);
+    return BuildRoute(*tree, to);
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo>
+DijkstraRouter<Weight>::BuildRoute(const ShortestPathTree& tree, VertexId to) const {
+    if (to >= tree.size()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    const auto& route_internal_data = tree[to];
+    if (!route_internal_data) {
+        return std::nullopt;
+    }
+    const Weight weight = route_internal_data->weight;
+    std::vector<EdgeId> edges;
+    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
+         edge_id;
+         edge_id = tree[graph_.GetEdge(*edge_id).from]->prev_edge)
+    {
+        edges.push_back(*edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{weight, std::move(edges)};
+}
+
+}  // namespace graph
@@ -33,6 +33,8 @@ struct Bus {
     std::vector<const Stop*> stops_;
     BusType bus_type_;
     int id = 0;
+    // расписание: отправления рейсов с первой остановки, мин; пусто - автобус без расписания
+    std::vector<double> departures_;
 };
 
 struct CoordinatesHasher {
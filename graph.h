@@ -2,7 +2,12 @@
 
 #include "ranges.h"
 
+#include <cassert>
+#include <cstddef>
 #include <cstdlib>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
 #include <vector>
 
 namespace graph {
@@ -17,47 +22,144 @@ struct Edge {
     Weight weight;
 };
 
+// Итератор по EdgeId: по массиву ids с позиции position или, если ids == nullptr,
+// по самим числам position, position + 1, ... - ребра замороженного графа
+// упорядочены по from, и ребра вершины - отрезок номеров без отдельного массива
+class EdgeIdIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = EdgeId;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const EdgeId*;
+    using reference = EdgeId;
+
+    EdgeIdIterator() = default;
+    EdgeIdIterator(const EdgeId* ids, size_t position)
+        : ids_(ids)
+        , position_(position) {
+    }
+
+    EdgeId operator*() const {
+        return ids_ ? ids_[position_] : position_;
+    }
+    EdgeIdIterator& operator++() {
+        ++position_;
+        return *this;
+    }
+    EdgeIdIterator operator++(int) {
+        EdgeIdIterator result = *this;
+        ++position_;
+        return result;
+    }
+    bool operator==(const EdgeIdIterator& other) const {
+        return position_ == other.position_ && ids_ == other.ids_;
+    }
+    bool operator!=(const EdgeIdIterator& other) const {
+        return !(*this == other);
+    }
+
+private:
+    const EdgeId* ids_ = nullptr;
+    size_t position_ = 0;
+};
+
+// Граф строится добавлением ребер, после чего его можно "заморозить" (Freeze):
+// ребра переупорядочиваются по вершине-источнику и хранятся в формате CSR -
+// массив смещений по вершинам и непрерывные массивы ребер.
+// В замороженный граф ребра не добавляются; чтобы дополнить граф, его нужно
+// "разморозить" (Unfreeze) - EdgeId существующих ребер при этом не меняются.
 template <typename Weight>
 class DirectedWeightedGraph {
 private:
     using IncidenceList = std::vector<EdgeId>;
-    using IncidentEdgesRange = ranges::Range<typename IncidenceList::const_iterator>;
+    using IncidentEdgesRange = ranges::Range<EdgeIdIterator>;
     
 public:
     DirectedWeightedGraph() = default;
     explicit DirectedWeightedGraph(size_t vertex_count);
+    // замороженный граф из готовых массивов CSR:
+    // ребра упорядочены по from, ребра вершины v - [offsets[v], offsets[v + 1])
+    DirectedWeightedGraph(std::vector<Edge<Weight>>&& edges, std::vector<EdgeId>&& incidence_offsets);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    // новые вершины получают VertexId после уже существующих
+    void AddVertices(size_t count);
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // Переводит граф в CSR. Возвращает перестановку ребер:
+    // result[new_edge_id] = old_edge_id. Порядок ребер одной вершины сохраняется,
+    // поэтому для уже упорядоченного графа перестановка тождественная.
+    std::vector<EdgeId> Freeze();
+    // возвращает граф к спискам инцидентности с той же нумерацией ребер
+    void Unfreeze();
+    bool IsFrozen() const;
+
     // **** for serialization purposes ****
     const std::vector<Edge<Weight>>& GetEdges() const;
     const std::vector<IncidenceList>& GetIncidenceLists() const;
+    const std::vector<EdgeId>& GetIncidenceOffsets() const;
 
 private:
     std::vector<Edge<Weight>> edges_;
+    // до заморозки: списки исходящих ребер по вершинам
     std::vector<IncidenceList> incidence_lists_;
+
+    // после заморозки: CSR
+    bool frozen_ = false;
+    size_t vertex_count_ = 0;
+    std::vector<EdgeId> incidence_offsets_;
 };
 
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {
+    : incidence_lists_(vertex_count)
+    , vertex_count_(vertex_count) {
+}
+
+template <typename Weight>
+DirectedWeightedGraph<Weight>::DirectedWeightedGraph(std::vector<Edge<Weight>>&& edges,
+                                                     std::vector<EdgeId>&& incidence_offsets)
+    : edges_(std::move(edges))
+    , frozen_(true)
+    , vertex_count_(incidence_offsets.empty() ? 0 : incidence_offsets.size() - 1)
+    , incidence_offsets_(std::move(incidence_offsets)) {
+    if (incidence_offsets_.empty() || incidence_offsets_.back() != edges_.size()) {
+        throw std::invalid_argument("Bad incidence offsets");
+    }
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        for (EdgeId edge_id = incidence_offsets_[vertex]; edge_id < incidence_offsets_[vertex + 1]; ++edge_id) {
+            if (edges_[edge_id].from != vertex) {
+                throw std::invalid_argument("Edges are not ordered by source vertex");
+            }
+        }
+    }
 }
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    if (frozen_) {
+        throw std::logic_error("Can't add edge to frozen graph");
+    }
+    incidence_lists_.at(edge.from).push_back(edges_.size());
     edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_.at(edge.from).push_back(id);
-    return id;
+    return edges_.size() - 1;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::AddVertices(size_t count) {
+    if (frozen_) {
+        throw std::logic_error("Can't add vertices to frozen graph");
+    }
+    vertex_count_ += count;
+    incidence_lists_.resize(vertex_count_);
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
 }
 
 template <typename Weight>
@@ -67,13 +169,76 @@ size_t DirectedWeightedGraph<Weight>::GetEdgeCount() const {
 
 template <typename Weight>
 const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
-    return edges_.at(edge_id);
+    assert(edge_id < edges_.size());
+    return edges_[edge_id];
 }
 
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange 
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
-    return ranges::AsRange(incidence_lists_.at(vertex));
+    if (frozen_) {
+        assert(vertex < vertex_count_);
+        return {EdgeIdIterator(nullptr, incidence_offsets_[vertex]),
+                EdgeIdIterator(nullptr, incidence_offsets_[vertex + 1])};
+    }
+    const IncidenceList& incidence_list = incidence_lists_.at(vertex);
+    return {EdgeIdIterator(incidence_list.data(), 0), EdgeIdIterator(incidence_list.data(), incidence_list.size())};
+}
+
+template <typename Weight>
+std::vector<EdgeId> DirectedWeightedGraph<Weight>::Freeze() {
+    if (frozen_) {
+        std::vector<EdgeId> identity(edges_.size());
+        std::iota(identity.begin(), identity.end(), EdgeId{0});
+        return identity;
+    }
+
+    incidence_offsets_.assign(vertex_count_ + 1, 0);
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        incidence_offsets_[vertex + 1] = incidence_offsets_[vertex] + incidence_lists_[vertex].size();
+    }
+
+    // списки инцидентности уже содержат ребра каждой вершины в порядке добавления
+    std::vector<EdgeId> new_to_old;
+    new_to_old.reserve(edges_.size());
+    for (const IncidenceList& incidence_list : incidence_lists_) {
+        new_to_old.insert(new_to_old.end(), incidence_list.begin(), incidence_list.end());
+    }
+
+    std::vector<Edge<Weight>> edges;
+    edges.reserve(edges_.size());
+    for (const EdgeId old_edge_id : new_to_old) {
+        edges.push_back(edges_[old_edge_id]);
+    }
+    edges_ = std::move(edges);
+
+    incidence_lists_.clear();
+    incidence_lists_.shrink_to_fit();
+    frozen_ = true;
+
+    return new_to_old;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Unfreeze() {
+    if (!frozen_) {
+        return;
+    }
+    incidence_lists_.assign(vertex_count_, {});
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        IncidenceList& incidence_list = incidence_lists_[vertex];
+        incidence_list.resize(incidence_offsets_[vertex + 1] - incidence_offsets_[vertex]);
+        std::iota(incidence_list.begin(), incidence_list.end(), incidence_offsets_[vertex]);
+    }
+
+    incidence_offsets_.clear();
+    incidence_offsets_.shrink_to_fit();
+    frozen_ = false;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return frozen_;
 }
 
 template <typename Weight>
@@ -86,4 +251,9 @@ const std::vector<std::vector<EdgeId>>&
 DirectedWeightedGraph<Weight>::GetIncidenceLists() const {
     return incidence_lists_;
 }
+
+template <typename Weight>
+const std::vector<EdgeId>& DirectedWeightedGraph<Weight>::GetIncidenceOffsets() const {
+    return incidence_offsets_;
+}
 } // namespace graph
\ No newline at end of file
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Индекс меток хабов (2-hop labeling).
+// У каждой вершины v две метки - отсортированные по рангу хаба списки:
+// исходящая (кратчайшие пути v -> хаб) и входящая (хаб -> v). Кратчайший путь
+// from -> to проходит через общий хаб исходящей метки from и входящей метки to,
+// поэтому запрос - слияние двух отсортированных массивов, без поиска по графу.
+// Метки строятся отсечением по ориентирам (pruned landmark labeling): из хабов по
+// порядку запускается поиск Дейкстры, и вершина, путь до которой уже покрыт
+// метками предыдущих хабов, не получает метку и не раскрывается.
+// Для раскрытия пути в каждой записи метки хранится соседнее ребро дерева путей хаба.
+template <typename Weight>
+class HubLabels {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+    struct Label {
+        // ранг хаба
+        uint32_t hub;
+        // Ребро дерева путей хаба: для исходящей метки - первое ребро пути v -> хаб,
+        // для входящей - последнее ребро пути хаб -> v; NO_EDGE для самого хаба
+        uint32_t parent_edge;
+        Weight weight;
+    };
+
+    // метки вершин подряд (CSR): метка v - labels[offsets[v]] ... labels[offsets[v + 1] - 1]
+    struct LabelSet {
+        std::vector<uint32_t> offsets;
+        std::vector<Label> labels;
+    };
+
+    // порядок хабов - по убыванию суммы входящей и исходящей степени вершин
+    explicit HubLabels(const Graph& graph);
+    // order[rank] = VertexId - например, порядок по географии остановок
+    HubLabels(const Graph& graph, std::vector<VertexId>&& order);
+    HubLabels(const Graph& graph, std::vector<VertexId>&& order, LabelSet&& out_labels, LabelSet&& in_labels);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // **** for serialization purposes ****
+    const std::vector<VertexId>& GetOrder() const;
+    const LabelSet& GetOutLabels() const;
+    const LabelSet& GetInLabels() const;
+
+private:
+    struct QueueEntry {
+        Weight weight;
+        VertexId vertex;
+
+        bool operator>(const QueueEntry& other) const {
+            return weight > other.weight;
+        }
+    };
+    using Queue = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>>;
+
+    // метки на время построения - списки дописываются по мере обработки хабов
+    using LabelLists = std::vector<std::vector<Label>>;
+
+    // Рабочие массивы поиска от хаба; после поиска затронутые ячейки сбрасываются,
+    // чтобы не заполнять массивы заново для каждого хаба
+    struct SearchWorkspace {
+        std::vector<std::optional<Weight>> weights;
+        std::vector<uint32_t> parent_edges;
+        std::vector<bool> settled;
+        std::vector<VertexId> touched;
+        // вес до хабов из метки текущего хаба, индекс - ранг
+        std::vector<std::optional<Weight>> hub_weights;
+
+        // входящие ребра вершин (CSR) для обратного поиска
+        std::vector<EdgeId> incoming_offsets;
+        std::vector<EdgeId> incoming_edges;
+    };
+
+    static std::vector<VertexId> ComputeDegreeOrder(const Graph& graph);
+    void CheckOrder() const;
+    void BuildLabels();
+    // Поиск от хаба rank: forward - по исходящим ребрам (дополняет входящие метки вершин),
+    // иначе по входящим (исходящие метки)
+    void PrunedSearch(uint32_t rank, bool forward, LabelLists& out_labels, LabelLists& in_labels,
+                      SearchWorkspace& workspace) const;
+    static LabelSet Compact(LabelLists&& labels);
+
+    const Label* FindLabel(const LabelSet& label_set, VertexId vertex, uint32_t hub) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+
+    const Graph& graph_;
+    std::vector<VertexId> order_;
+    LabelSet out_labels_;
+    LabelSet in_labels_;
+};
+
+template <typename Weight>
+HubLabels<Weight>::HubLabels(const Graph& graph)
+    : HubLabels(graph, ComputeDegreeOrder(graph)) {
+}
+
+template <typename Weight>
+HubLabels<Weight>::HubLabels(const Graph& graph, std::vector<VertexId>&& order)
+    : graph_(graph)
+    , order_(std::move(order))
+{
+    if (graph_.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for hub labels");
+    }
+    CheckOrder();
+    BuildLabels();
+}
+
+template <typename Weight>
+HubLabels<Weight>::HubLabels(const Graph& graph, std::vector<VertexId>&& order,
+                             LabelSet&& out_labels, LabelSet&& in_labels)
+    : graph_(graph)
+    , order_(std::move(order))
+    , out_labels_(std::move(out_labels))
+    , in_labels_(std::move(in_labels))
+{
+    CheckOrder();
+    for (const LabelSet* label_set : {&out_labels_, &in_labels_}) {
+        if (label_set->offsets.size() != graph_.GetVertexCount() + 1
+            || label_set->offsets.back() != label_set->labels.size()) {
+            throw std::invalid_argument("Bad hub labels");
+        }
+    }
+}
+
+template <typename Weight>
+std::vector<VertexId> HubLabels<Weight>::ComputeDegreeOrder(const Graph& graph) {
+    std::vector<size_t> degrees(graph.GetVertexCount(), 0);
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph.GetEdge(edge_id);
+        ++degrees[edge.from];
+        ++degrees[edge.to];
+    }
+    std::vector<VertexId> order(graph.GetVertexCount());
+    for (VertexId vertex = 0; vertex < order.size(); ++vertex) {
+        order[vertex] = vertex;
+    }
+    // при равной степени - по VertexId, чтобы база не зависела от реализации сортировки
+    std::stable_sort(order.begin(), order.end(), [&degrees](VertexId lhs, VertexId rhs) {
+        return degrees[lhs] > degrees[rhs];
+    });
+    return order;
+}
+
+template <typename Weight>
+void HubLabels<Weight>::CheckOrder() const {
+    if (order_.size() != graph_.GetVertexCount()) {
+        throw std::invalid_argument("Hub order should contain every vertex");
+    }
+    std::vector<bool> seen(order_.size(), false);
+    for (const VertexId vertex : order_) {
+        if (vertex >= order_.size() || seen[vertex]) {
+            throw std::invalid_argument("Hub order should contain every vertex");
+        }
+        seen[vertex] = true;
+    }
+}
+
+template <typename Weight>
+void HubLabels<Weight>::BuildLabels() {
+    const size_t vertex_count = graph_.GetVertexCount();
+
+    SearchWorkspace workspace;
+    workspace.weights.assign(vertex_count, std::nullopt);
+    workspace.parent_edges.assign(vertex_count, NO_EDGE);
+    workspace.settled.assign(vertex_count, false);
+    workspace.hub_weights.assign(vertex_count, std::nullopt);
+
+    workspace.incoming_offsets.assign(vertex_count + 1, 0);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (edge.weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        ++workspace.incoming_offsets[edge.to + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        workspace.incoming_offsets[vertex + 1] += workspace.incoming_offsets[vertex];
+    }
+    workspace.incoming_edges.resize(workspace.incoming_offsets.back());
+    std::vector<EdgeId> incoming_fill(workspace.incoming_offsets.begin(), workspace.incoming_offsets.end() - 1);
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        workspace.incoming_edges[incoming_fill[graph_.GetEdge(edge_id).to]++] = edge_id;
+    }
+
+    LabelLists out_labels(vertex_count);
+    LabelLists in_labels(vertex_count);
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        PrunedSearch(rank, true, out_labels, in_labels, workspace);
+        PrunedSearch(rank, false, out_labels, in_labels, workspace);
+    }
+    out_labels_ = Compact(std::move(out_labels));
+    in_labels_ = Compact(std::move(in_labels));
+}
+
+template <typename Weight>
+void HubLabels<Weight>::PrunedSearch(uint32_t rank, bool forward, LabelLists& out_labels, LabelLists& in_labels,
+                                     SearchWorkspace& workspace) const {
+    const VertexId hub = order_[rank];
+    // метки, которые дополняет поиск, и противоположная метка самого хаба
+    LabelLists& labels = forward ? in_labels : out_labels;
+    const std::vector<Label>& hub_labels = forward ? out_labels[hub] : in_labels[hub];
+
+    for (const Label& label : hub_labels) {
+        workspace.hub_weights[label.hub] = label.weight;
+    }
+    // покрыт ли путь между хабом и vertex весом weight метками предыдущих хабов
+    auto is_covered = [&](VertexId vertex, const Weight& weight) {
+        for (const Label& label : labels[vertex]) {
+            const std::optional<Weight>& hub_weight = workspace.hub_weights[label.hub];
+            if (hub_weight && !(weight < *hub_weight + label.weight)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    Queue queue;
+    workspace.weights[hub] = ZERO_WEIGHT;
+    workspace.touched.push_back(hub);
+    queue.push({ZERO_WEIGHT, hub});
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().vertex;
+        queue.pop();
+        // в очереди могут остаться устаревшие записи вершины
+        if (workspace.settled[vertex]) {
+            continue;
+        }
+        workspace.settled[vertex] = true;
+
+        const Weight vertex_weight = *workspace.weights[vertex];
+        if (is_covered(vertex, vertex_weight)) {
+            continue;
+        }
+        labels[vertex].push_back({rank, workspace.parent_edges[vertex], vertex_weight});
+
+        const EdgeIdIterator begin = forward
+            ? graph_.GetIncidentEdges(vertex).begin()
+            : EdgeIdIterator(workspace.incoming_edges.data(), workspace.incoming_offsets[vertex]);
+        const EdgeIdIterator end = forward
+            ? graph_.GetIncidentEdges(vertex).end()
+            : EdgeIdIterator(workspace.incoming_edges.data(), workspace.incoming_offsets[vertex + 1]);
+        for (EdgeIdIterator it = begin; it != end; ++it) {
+            const auto& edge = graph_.GetEdge(*it);
+            const VertexId next = forward ? edge.to : edge.from;
+            const Weight candidate = vertex_weight + edge.weight;
+            std::optional<Weight>& next_weight = workspace.weights[next];
+            if (workspace.settled[next] || (next_weight && !(candidate < *next_weight))) {
+                continue;
+            }
+            if (!next_weight) {
+                workspace.touched.push_back(next);
+            }
+            next_weight = candidate;
+            workspace.parent_edges[next] = static_cast<uint32_t>(*it);
+            queue.push({candidate, next});
+        }
+    }
+
+    for (const VertexId vertex : workspace.touched) {
+        workspace.weights[vertex] = std::nullopt;
+        workspace.parent_edges[vertex] = NO_EDGE;
+        workspace.settled[vertex] = false;
+    }
+    workspace.touched.clear();
+    for (const Label& label : hub_labels) {
+        workspace.hub_weights[label.hub] = std::nullopt;
+    }
+}
+
+template <typename Weight>
+typename HubLabels<Weight>::LabelSet HubLabels<Weight>::Compact(LabelLists&& labels) {
+    LabelSet result;
+    result.offsets.reserve(labels.size() + 1);
+    result.offsets.push_back(0);
+    for (const std::vector<Label>& vertex_labels : labels) {
+        result.offsets.push_back(result.offsets.back() + vertex_labels.size());
+    }
+    result.labels.reserve(result.offsets.back());
+    for (std::vector<Label>& vertex_labels : labels) {
+        result.labels.insert(result.labels.end(), vertex_labels.begin(), vertex_labels.end());
+        std::vector<Label>().swap(vertex_labels);
+    }
+    return result;
+}
+
+template <typename Weight>
+const typename HubLabels<Weight>::Label*
+HubLabels<Weight>::FindLabel(const LabelSet& label_set, VertexId vertex, uint32_t hub) const {
+    const Label* begin = label_set.labels.data() + label_set.offsets[vertex];
+    const Label* end = label_set.labels.data() + label_set.offsets[vertex + 1];
+    const Label* it = std::lower_bound(begin, end, hub, [](const Label& label, uint32_t value) {
+        return label.hub < value;
+    });
+    if (it == end || it->hub != hub) {
+        throw std::logic_error("Hub labels are inconsistent");
+    }
+    return it;
+}
+
+template <typename Weight>
+std::optional<typename HubLabels<Weight>::RouteInfo> HubLabels<Weight>::BuildRoute(VertexId from,
+                                                                                   VertexId to) const {
+    if (from >= graph_.GetVertexCount() || to >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}};
+    }
+
+    // слияние меток, отсортированных по рангу хаба
+    const Label* out_it = out_labels_.labels.data() + out_labels_.offsets[from];
+    const Label* out_end = out_labels_.labels.data() + out_labels_.offsets[from + 1];
+    const Label* in_it = in_labels_.labels.data() + in_labels_.offsets[to];
+    const Label* in_end = in_labels_.labels.data() + in_labels_.offsets[to + 1];
+    std::optional<Weight> best_weight;
+    uint32_t best_hub = 0;
+    while (out_it != out_end && in_it != in_end) {
+        if (out_it->hub < in_it->hub) {
+            ++out_it;
+        } else if (in_it->hub < out_it->hub) {
+            ++in_it;
+        } else {
+            const Weight weight = out_it->weight + in_it->weight;
+            if (!best_weight || weight < *best_weight) {
+                best_weight = weight;
+                best_hub = out_it->hub;
+            }
+            ++out_it;
+            ++in_it;
+        }
+    }
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    // from -> хаб по исходящим меткам, хаб -> to по входящим (с конца)
+    const VertexId hub_vertex = order_[best_hub];
+    std::vector<EdgeId> edges;
+    for (VertexId vertex = from; vertex != hub_vertex;) {
+        const EdgeId edge_id = FindLabel(out_labels_, vertex, best_hub)->parent_edge;
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).to;
+    }
+    const size_t hub_position = edges.size();
+    for (VertexId vertex = to; vertex != hub_vertex;) {
+        const EdgeId edge_id = FindLabel(in_labels_, vertex, best_hub)->parent_edge;
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).from;
+    }
+    std::reverse(edges.begin() + hub_position, edges.end());
+
+    return RouteInfo{*best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+const std::vector<VertexId>& HubLabels<Weight>::GetOrder() const {
+    return order_;
+}
+
+template <typename Weight>
+const typename HubLabels<Weight>::LabelSet& HubLabels<Weight>::GetOutLabels() const {
+    return out_labels_;
+}
+
+template <typename Weight>
+const typename HubLabels<Weight>::LabelSet& HubLabels<Weight>::GetInLabels() const {
+    return in_labels_;
+}
+
+}  // namespace graph
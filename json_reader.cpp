@@ -45,6 +45,11 @@ void JsonReader::AddBusBaseRequest(const json::Node& request) {
     for(const auto& stop : stops) {
         add_bus_request.stops.push_back(std::move(stop.AsString()));
     }
+    if(request.AsDict().count("departures") != 0) {
+        for(const auto& departure : request.AsDict().at("departures").AsArray()) {
+            add_bus_request.departures.push_back(departure.AsDouble());
+        }
+    }
     add_bus_requests_.push_back(std::move(add_bus_request));
 }
 
@@ -144,6 +149,14 @@ json::Document JsonReader::ProcessStatRequests(RequestHandler& handler) {
         
             ProcessRouteRequest(handler, stat_request, answers_array);
 
+        } else if (request_type == "RouteMatrix"sv) {
+
+            ProcessRouteMatrixRequest(handler, stat_request, answers_array);
+
+        } else if (request_type == "Reachable"sv) {
+
+            ProcessReachableRequest(handler, stat_request, answers_array);
+
         } else {
             throw std::logic_error("bad stat request");
         }
@@ -241,20 +254,228 @@ catalogue::RoutingSettings JsonReader::ReadRoutingSettings(const json::Document&
     const json::Node& json_settings = document.GetRoot().AsDict().at("routing_settings").AsDict();
     settings.bus_wait_time = json_settings.AsDict().at("bus_wait_time").AsInt();
     settings.bus_velocity = json_settings.AsDict().at("bus_velocity").AsInt() * BUS_VELOCITY_MULTIPLIER;
+
+    // необязательные настройки алгоритма поиска маршрута
+    if(json_settings.AsDict().count("router_type") != 0) {
+        const std::string& router_type = json_settings.AsDict().at("router_type").AsString();
+        if(router_type == "all_pairs"sv) {
+            settings.router_type = catalogue::RouterType::ALL_PAIRS;
+        } else if(router_type == "dijkstra"sv) {
+            settings.router_type = catalogue::RouterType::DIJKSTRA;
+        } else if(router_type == "contraction_hierarchies"sv) {
+            settings.router_type = catalogue::RouterType::CONTRACTION_HIERARCHIES;
+        } else if(router_type == "a_star"sv) {
+            settings.router_type = catalogue::RouterType::A_STAR;
+        } else if(router_type == "hub_labels"sv) {
+            settings.router_type = catalogue::RouterType::HUB_LABELS;
+        } else if(router_type == "customizable_contraction_hierarchies"sv) {
+            settings.router_type = catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES;
+        } else {
+            throw std::logic_error("bad router type");
+        }
+    }
+    if(json_settings.AsDict().count("router_cache_size") != 0) {
+        const int router_cache_size = json_settings.AsDict().at("router_cache_size").AsInt();
+        if(router_cache_size < 0) {
+            throw std::logic_error("bad router cache size");
+        }
+        settings.router_cache_size = static_cast<size_t>(router_cache_size);
+    }
+    if(json_settings.AsDict().count("graph_model") != 0) {
+        const std::string& graph_model = json_settings.AsDict().at("graph_model").AsString();
+        if(graph_model == "arrival_departure"sv) {
+            settings.graph_model = catalogue::GraphModel::ARRIVAL_DEPARTURE;
+        } else if(graph_model == "single_vertex"sv) {
+            settings.graph_model = catalogue::GraphModel::SINGLE_VERTEX;
+        } else {
+            throw std::logic_error("bad graph model");
+        }
+    }
+    if(json_settings.AsDict().count("vertex_order") != 0) {
+        const std::string& vertex_order = json_settings.AsDict().at("vertex_order").AsString();
+        if(vertex_order == "input"sv) {
+            settings.vertex_order = catalogue::VertexOrder::INPUT;
+        } else if(vertex_order == "hilbert"sv) {
+            settings.vertex_order = catalogue::VertexOrder::HILBERT;
+        } else if(vertex_order == "reverse_cuthill_mckee"sv) {
+            settings.vertex_order = catalogue::VertexOrder::REVERSE_CUTHILL_MCKEE;
+        } else {
+            throw std::logic_error("bad vertex order");
+        }
+    }
+    if(json_settings.AsDict().count("profiles") != 0) {
+        settings.profiles = ReadProfiles(json_settings.AsDict().at("profiles"));
+    }
     return settings;
 }
 
+std::map<std::string, catalogue::RoutingProfile> JsonReader::ReadRoutingProfiles(const json::Document& document) const {
+    if(document.GetRoot().AsDict().count("routing_profiles") == 0) {
+        return {};
+    }
+    return ReadProfiles(document.GetRoot().AsDict().at("routing_profiles"));
+}
+
+bool JsonReader::HasRoutingRequests(const json::Document& document) const {
+    for(const auto& stat_request : document.GetRoot().AsDict().at("stat_requests").AsArray()) {
+        const std::string& request_type = stat_request.AsDict().at("type").AsString();
+        if(request_type != "Bus"sv && request_type != "Stop"sv && request_type != "Map"sv) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::map<std::string, catalogue::RoutingProfile> JsonReader::ReadProfiles(const json::Node& node) const {
+    std::map<std::string, catalogue::RoutingProfile> profiles;
+    for(const auto& [name, json_profile] : node.AsDict()) {
+        catalogue::RoutingProfile profile;
+        profile.bus_wait_time = json_profile.AsDict().at("bus_wait_time").AsDouble();
+        profile.bus_velocity = json_profile.AsDict().at("bus_velocity").AsDouble() * BUS_VELOCITY_MULTIPLIER;
+        if(profile.bus_velocity <= 0.0) {
+            throw std::logic_error("bad profile bus velocity");
+        }
+        profiles[name] = profile;
+    }
+    return profiles;
+}
+
 void JsonReader::ProcessRouteRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array) {
     int id = stat_request.AsDict().at("id").AsInt();
     std::string stop_from = stat_request.AsDict().at("from").AsString();
     std::string stop_to = stat_request.AsDict().at("to").AsString();
+    // расписание и поиск по раундам идут по справочнику, веса профиля к ним не применяются
+    if(stat_request.AsDict().count("profile") != 0
+       && (stat_request.AsDict().count("departure_time") != 0 || stat_request.AsDict().count("max_transfers") != 0
+           || stat_request.AsDict().count("pareto") != 0)) {
+        throw std::logic_error("profile can't be combined with departure_time, max_transfers or pareto");
+    }
+    if(stat_request.AsDict().count("departure_time") != 0) {
+        ProcessTimetableRouteRequest(handler, stat_request, answers_array);
+        return;
+    }
+    if(stat_request.AsDict().count("max_transfers") != 0 || stat_request.AsDict().count("pareto") != 0) {
+        ProcessJourneyRequest(handler, stat_request, answers_array);
+        return;
+    }
+    if(stat_request.AsDict().count("profile") != 0) {
+        // веса профиля - по настраиваемой иерархии сжатия
+        const std::string& profile_name = stat_request.AsDict().at("profile").AsString();
+        const catalogue::RoutingProfile& profile = handler.GetRoutingProfile(profile_name);
+        answers_array.push_back(ConvertRouteInfoToJsonDict(id,
+            handler.GetProfileRouteInfo(stop_from, stop_to, profile_name), handler, &profile));
+        return;
+    }
     std::optional<graph::Router<BusRouteWeight>::RouteInfo> route_info = handler.GetRouteInfo(stop_from, stop_to);
     answers_array.push_back(std::move(ConvertRouteInfoToJsonDict(id, route_info, handler)));
 }
 
+void JsonReader::ProcessJourneyRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array) {
+    int id = stat_request.AsDict().at("id").AsInt();
+    std::string stop_from = stat_request.AsDict().at("from").AsString();
+    std::string stop_to = stat_request.AsDict().at("to").AsString();
+    size_t max_transfers = catalogue::RaptorRouter::UNLIMITED_TRANSFERS;
+    if(stat_request.AsDict().count("max_transfers") != 0) {
+        const int json_max_transfers = stat_request.AsDict().at("max_transfers").AsInt();
+        if(json_max_transfers < 0) {
+            throw std::logic_error("bad max_transfers");
+        }
+        max_transfers = static_cast<size_t>(json_max_transfers);
+    }
+    // весь Парето-фронт (время, пересадки) или только самая быстрая поездка
+    const bool pareto = stat_request.AsDict().count("pareto") != 0
+        && stat_request.AsDict().at("pareto").AsBool();
+
+    const std::vector<catalogue::RaptorJourney> journeys = handler.GetJourneys(stop_from, stop_to, max_transfers);
+
+    json::Node answer = json::Builder{}
+        .StartDict()
+            .Key("request_id").Value(id)
+        .EndDict()
+    .Build();
+    if(journeys.empty()) {
+        answer.AsDict().emplace("error_message", "not found");
+    } else if(pareto) {
+        json::Array options;
+        for(const catalogue::RaptorJourney& journey : journeys) {
+            json::Dict option;
+            option.emplace("total_time", journey.total_time);
+            option.emplace("transfers", static_cast<int>(journey.transfers));
+            option.emplace("items", ConvertJourneyItemsToJsonArray(journey, handler));
+            options.push_back(std::move(option));
+        }
+        answer.AsDict().emplace("options", std::move(options));
+    } else {
+        answer.AsDict().emplace("total_time", journeys.back().total_time);
+        answer.AsDict().emplace("items", ConvertJourneyItemsToJsonArray(journeys.back(), handler));
+    }
+    answers_array.push_back(std::move(answer));
+}
+
+void JsonReader::ProcessTimetableRouteRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array) {
+    int id = stat_request.AsDict().at("id").AsInt();
+    std::string stop_from = stat_request.AsDict().at("from").AsString();
+    std::string stop_to = stat_request.AsDict().at("to").AsString();
+    const double departure_time = stat_request.AsDict().at("departure_time").AsDouble();
+
+    const std::optional<catalogue::TimetableJourney> journey = handler.GetTimetableJourney(stop_from, stop_to, departure_time);
+
+    json::Node answer = json::Builder{}
+        .StartDict()
+            .Key("request_id").Value(id)
+        .EndDict()
+    .Build();
+    if(!journey) {
+        answer.AsDict().emplace("error_message", "not found");
+        answers_array.push_back(std::move(answer));
+        return;
+    }
+    answer.AsDict().emplace("total_time", journey->arrival_time - journey->departure_time);
+    answer.AsDict().emplace("arrival_time", journey->arrival_time);
+
+    // ожидание - до отправления рейса по расписанию, а не RoutingSettings::bus_wait_time
+    json::Array items;
+    for(const catalogue::TimetableLeg& leg : journey->legs) {
+        json::Dict wait_item{};
+        wait_item.emplace("time", leg.wait_time);
+        wait_item.emplace("type", "Wait");
+        wait_item.emplace("stop_name", leg.from->name_);
+        items.push_back(std::move(wait_item));
+
+        json::Dict bus_item{};
+        bus_item.emplace("time", leg.ride_time);
+        bus_item.emplace("type", "Bus");
+        bus_item.emplace("bus", leg.bus->name_);
+        bus_item.emplace("span_count", leg.span);
+        items.push_back(std::move(bus_item));
+    }
+    answer.AsDict().emplace("items", std::move(items));
+    answers_array.push_back(std::move(answer));
+}
+
+json::Array JsonReader::ConvertJourneyItemsToJsonArray(const catalogue::RaptorJourney& journey, RequestHandler& handler) {
+    json::Array items;
+    // участки - в том же виде, что и у маршрута по графу: ожидание, затем поездка
+    for(const catalogue::RaptorLeg& leg : journey.legs) {
+        json::Dict wait_item{};
+        wait_item.emplace("time", handler.GetRoutingSettings().bus_wait_time);
+        wait_item.emplace("type", "Wait");
+        wait_item.emplace("stop_name", leg.from->name_);
+        items.push_back(std::move(wait_item));
+
+        json::Dict bus_item{};
+        bus_item.emplace("time", leg.ride_time);
+        bus_item.emplace("type", "Bus");
+        bus_item.emplace("bus", leg.bus->name_);
+        bus_item.emplace("span_count", leg.span);
+        items.push_back(std::move(bus_item));
+    }
+    return items;
+}
+
 json::Node JsonReader::ConvertRouteInfoToJsonDict(int id, 
             std::optional<graph::Router<BusRouteWeight>::RouteInfo> route_info,
-            RequestHandler& handler) {
+            RequestHandler& handler, const catalogue::RoutingProfile* profile) {
     
     // ответ в любом случае содержит ид запроса
     json::Node answer = json::Builder{}
@@ -267,51 +488,145 @@ json::Node JsonReader::ConvertRouteInfoToJsonDict(int id,
         // маршрут существует и построен
         // добавим пару "полное время поездки"
         answer.AsDict().emplace("total_time", route_info->weight.time);
-        answer.AsDict().emplace("items", json::Array{});
-        json::Array& items = answer.AsDict().at("items").AsArray();
+        answer.AsDict().emplace("items", ConvertRouteItemsToJsonArray(*route_info, handler, profile));
+
+    } else {
+        // маршрут не существует
+        answer.AsDict().emplace("error_message", "not found");
+    }
+    return answer;
+}
+
+json::Array JsonReader::ConvertRouteItemsToJsonArray(const graph::Router<BusRouteWeight>::RouteInfo& route_info,
+            RequestHandler& handler, const catalogue::RoutingProfile* profile) {
+    json::Array items;
+    const double bus_wait_time = profile ? profile->bus_wait_time : handler.GetRoutingSettings().bus_wait_time;
+
+    // цикл по участкам (ребрам) поздки
+    for(const graph::EdgeId edge_id : route_info.edges) {
+        // item begins
+        json::Dict item{};
+
+        // временно запомнить ссылку на ребро
+        const graph::Edge<BusRouteWeight>& edge = handler.GetEdgeByIndex(edge_id);
+
+        if(auto bus = handler.GetBusByEdgeIndex(edge_id)) {
+            if(handler.GetRoutingSettings().graph_model == catalogue::GraphModel::SINGLE_VERTEX) {
+                // ожидание входит в вес ребра поездки - выводится отдельным участком
+                json::Dict wait_item{};
+                wait_item.emplace("time", bus_wait_time);
+                wait_item.emplace("type", "Wait");
+                wait_item.emplace("stop_name", handler.GetStopByVertexIndex(edge.from)->name_);
+                items.push_back(std::move(wait_item));
+            }
 
-        // цикл по участкам (ребрам) поздки
-        for(const graph::EdgeId edge_id : route_info->edges) {
-            // item begins
-            json::Dict item{};
+            // это ребро графа соответствует поездке на автобусе
+            item.emplace("time", profile ? handler.GetBusRideTime(edge_id, *profile) : handler.GetBusRideTime(edge_id));
+            item.emplace("type", "Bus");
 
-            // временно запомнить ссылку на ребро
-            const graph::Edge<BusRouteWeight>& edge = handler.GetEdgeByIndex(edge_id);
-            //время данного участка пути
-            double time = edge.weight.time;
-            item.emplace("time", time);
+            std::string bus_name = bus->name_;
+            item.emplace("bus", bus_name);
 
-            if(auto bus = handler.GetBusByEdgeIndex(edge_id)) {
-                // это ребро графа соответствует поездке на автобусе
-                item.emplace("type", "Bus");
+            item.emplace("span_count", edge.weight.span);
 
-                std::string bus_name = bus->name_;
-                item.emplace("bus", bus_name);
+        } else {
+            // то ребро соответствует ожижданию на остановке
+            item.emplace("time", profile ? profile->bus_wait_time : edge.weight.time);
+            item.emplace("type", "Wait");
+            item.emplace(
+                "stop_name", 
+                handler.GetStopByVertexIndex(edge.from)->name_
+            );
+        }
+        items.push_back(std::move(item));
+    }
+    return items;
+}
 
-                item.emplace("span_count", edge.weight.span);
+void JsonReader::ProcessRouteMatrixRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array) {
+    int id = stat_request.AsDict().at("id").AsInt();
+    std::vector<std::string_view> stops_from;
+    for(const json::Node& stop : stat_request.AsDict().at("from").AsArray()) {
+        stops_from.push_back(stop.AsString());
+    }
+    std::vector<std::string_view> stops_to;
+    for(const json::Node& stop : stat_request.AsDict().at("to").AsArray()) {
+        stops_to.push_back(stop.AsString());
+    }
+    // маршруты целиком выводятся только по запросу - матрица времен намного компактнее
+    const bool with_itineraries = stat_request.AsDict().count("itineraries") != 0
+        && stat_request.AsDict().at("itineraries").AsBool();
+
+    // один поиск на каждую различную остановку отправления
+    std::map<std::string_view, std::vector<std::optional<graph::Router<BusRouteWeight>::RouteInfo>>> routes_by_source;
+    for(std::string_view stop_from : stops_from) {
+        if(routes_by_source.count(stop_from) == 0) {
+            routes_by_source.emplace(stop_from, handler.GetRoutesFromStop(stop_from, stops_to));
+        }
+    }
 
+    // строка i - остановка from[i], столбец j - остановка to[j]; null - маршрута нет
+    json::Array total_times;
+    json::Array routes;
+    for(std::string_view stop_from : stops_from) {
+        json::Array times_row;
+        json::Array routes_row;
+        for(const auto& route_info : routes_by_source.at(stop_from)) {
+            if(route_info.has_value()) {
+                times_row.push_back(route_info->weight.time);
             } else {
-                // то ребро соответствует ожижданию на остановке
-                item.emplace("type", "Wait");
-                item.emplace(
-                    "stop_name", 
-                    handler.GetStopByVertexIndex(edge.from)->name_
-                );
+                times_row.push_back(nullptr);
+            }
+            if(with_itineraries) {
+                routes_row.push_back(ConvertRouteInfoToJsonDict(id, route_info, handler));
+                routes_row.back().AsDict().erase("request_id");
             }
-            items.push_back(std::move(item));
         }
+        total_times.push_back(std::move(times_row));
+        if(with_itineraries) {
+            routes.push_back(std::move(routes_row));
+        }
+    }
 
-    } else {
-        // маршрут не существует
-        answer.AsDict().emplace("error_message", "not found");
+    json::Node answer = json::Builder{}
+        .StartDict()
+            .Key("request_id").Value(id)
+            .Key("total_times").Value(std::move(total_times))
+        .EndDict()
+    .Build();
+    if(with_itineraries) {
+        answer.AsDict().emplace("routes", std::move(routes));
     }
-    return answer;
+    answers_array.push_back(std::move(answer));
+}
+
+void JsonReader::ProcessReachableRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array) {
+    int id = stat_request.AsDict().at("id").AsInt();
+    const auto reachable_stops = handler.GetReachableStops(stat_request.AsDict().at("from").AsString(),
+                                                           stat_request.AsDict().at("max_time").AsDouble());
+
+    json::Array stops;
+    for(const auto& [stop, time] : reachable_stops) {
+        stops.push_back(json::Builder{}
+            .StartDict()
+                .Key("stop_name").Value(stop->name_)
+                .Key("time").Value(time)
+            .EndDict()
+        .Build());
+    }
+
+    answers_array.push_back(json::Builder{}
+        .StartDict()
+            .Key("request_id").Value(id)
+            .Key("stops").Value(std::move(stops))
+        .EndDict()
+    .Build());
 }
 
 // одновременное заполнение каталога и рутера необходимо для миимизации числа циклов
 // в одном цикле по остановкам заполняются остановки справочника +
 // + добавляем вершины графа
-void JsonReader::Fill(catalogue::TransportCatalogue& catalogue, catalogue::TransportRouter& router) {
+void JsonReader::Fill(catalogue::TransportCatalogue& catalogue, catalogue::TransportRouter& router, size_t thread_count) {
     for(const auto& [name, coordinates, _] : add_stop_requests_) {
         catalogue.AddStop(name, coordinates);
     }
@@ -327,18 +642,20 @@ void JsonReader::Fill(catalogue::TransportCatalogue& catalogue, catalogue::Trans
 
     router.AddBusWaitEdges();
 
-    // в одном цикле по запросам на добавление автобуса добавляем автобусы и 
-    // ребра графа
-    for(const auto& [name, stops, type] : add_bus_requests_) {
+    // сначала все автобусы справочника, затем ребра графа для них -
+    // ребра разных автобусов строятся независимо
+    std::vector<std::string_view> bus_names;
+    for(const auto& [name, stops, type, departures] : add_bus_requests_) {
         BusType bus_type;
         if(type) {
             bus_type = BusType::CYCLED;
         } else {
             bus_type = BusType::ORDINARY;
         }
-        catalogue.AddBus(name, stops, bus_type);
-        router.AddBusEdges(name);
-    }  
+        catalogue.AddBus(name, stops, bus_type, departures);
+        bus_names.push_back(name);
+    }
+    router.AddBusesEdges(bus_names, thread_count);
 }
 
 Serialize::SerializeSettings JsonReader::ReadSerializeSettings(const json::Document& document) const {
@@ -347,7 +664,21 @@ Serialize::SerializeSettings JsonReader::ReadSerializeSettings(const json::Docum
     assert(document.GetRoot().AsDict().count("serialization_settings") != 0);
 
     
-    settings.file = document.GetRoot().AsDict().at("serialization_settings").AsDict().at("file").AsString();
+    const json::Dict& serialization_settings = document.GetRoot().AsDict().at("serialization_settings").AsDict();
+    settings.file = serialization_settings.at("file").AsString();
+    if(const auto it = serialization_settings.find("router_file"); it != serialization_settings.end()) {
+        settings.router_file = it->second.AsString();
+    }
+    if(const auto it = serialization_settings.find("format"); it != serialization_settings.end()) {
+        const std::string& format = it->second.AsString();
+        if(format == "protobuf"sv) {
+            settings.format = Serialize::BaseFormat::PROTOBUF;
+        } else if(format == "mapped"sv) {
+            settings.format = Serialize::BaseFormat::MAPPED;
+        } else {
+            throw std::logic_error("bad base format");
+        }
+    }
     
     return settings;
 }
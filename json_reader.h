@@ -34,6 +34,8 @@ struct AddBusRequest {
     std::string name;
     std::vector<std::string> stops;
     bool is_roundtrip;
+    // необязательное поле "departures" - отправления рейсов с первой остановки, мин
+    std::vector<double> departures;
 };
 
 struct StatRequest{
@@ -48,7 +50,8 @@ public:
 
     void ReadBaseRequests(json::Document document);
     json::Document ProcessStatRequests(RequestHandler& handler);
-    void Fill(catalogue::TransportCatalogue& catalogue, catalogue::TransportRouter& router);
+    // thread_count - потоков для построения ребер поездок
+    void Fill(catalogue::TransportCatalogue& catalogue, catalogue::TransportRouter& router, size_t thread_count = 1);
 
     // ---- rendering ----
     renderer::RenderSettings ReadRenderSettingsFromJSON(const json::Document& document) const;
@@ -56,6 +59,10 @@ public:
 
     // ---- routing ----
     catalogue::RoutingSettings ReadRoutingSettings(const json::Document& document) const;
+    // профили, заданные при обработке запросов ("routing_profiles"): дополняют профили базы
+    std::map<std::string, catalogue::RoutingProfile> ReadRoutingProfiles(const json::Document& document) const;
+    // в stat_requests есть запросы, кроме Bus, Stop и Map - им нужен поиск маршрута
+    bool HasRoutingRequests(const json::Document& document) const;
     void SetRoutingSettings(catalogue::RoutingSettings settings, catalogue::TransportCatalogue& catalogue) const;
 
     // ---- serialization ----
@@ -68,18 +75,32 @@ private:
     void AddBusBaseRequest(const json::Node& request);
 
     svg::Color ReadColor(const json::Node& node) const;
+    // {"имя": {"bus_wait_time": ..., "bus_velocity": ...}} - в тех же единицах, что и routing_settings
+    std::map<std::string, catalogue::RoutingProfile> ReadProfiles(const json::Node& node) const;
 
     json::Node ConvertBusStatToJsonDict(int id, std::optional<BusStat> bus_stat);
     json::Node ConvertStopInfoToJsonDict(int id, std::optional<StopInfo> bus_stat);
     json::Node ConvertMapToJsonDict(int id, std::string map_as_string);
+    // profile - веса профиля, nullptr - основные настройки
     json::Node ConvertRouteInfoToJsonDict(int id, 
             std::optional<graph::Router<BusRouteWeight>::RouteInfo> route_info,
-            RequestHandler& handler);
+            RequestHandler& handler, const catalogue::RoutingProfile* profile = nullptr);
+    json::Array ConvertRouteItemsToJsonArray(const graph::Router<BusRouteWeight>::RouteInfo& route_info,
+            RequestHandler& handler, const catalogue::RoutingProfile* profile = nullptr);
 
     void ProcessBusStatRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
     void ProcessStopInfoRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
     void ProcessMapRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
+    json::Array ConvertJourneyItemsToJsonArray(const catalogue::RaptorJourney& journey, RequestHandler& handler);
+
     void ProcessRouteRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
+    // Route с "max_transfers" или "pareto" - поиск по раундам (RAPTOR)
+    void ProcessJourneyRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
+    // Route с "departure_time" - поиск по расписанию (Connection Scan)
+    void ProcessTimetableRouteRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
+    void ProcessRouteMatrixRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
+    // остановки, достижимые из "from" не дольше чем за "max_time" минут
+    void ProcessReachableRequest(RequestHandler& handler, const json::Node& stat_request, json::Array& answers_array);
     json::Document document_;
 };
 
@@ -6,22 +6,266 @@
 #include "serialization.h"
 
 #include <transport_catalogue.pb.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|update_base|process_requests|benchmark] [--threads N] [--base FILE]\n"sv;
+}
+
+// Сравнение числа раскрытых вершин на запросах Route входного файла:
+// алгоритм Дейкстры (дерево путей целиком), двунаправленный Дейкстра и двунаправленный A*.
+// Для поиска по раундам (RAPTOR) и алгоритма Дейкстры - еще и время всех запросов.
+// Запрос Reachable (ограниченный поиск Дейкстры) сравнивается с запросами Route из той же
+// остановки во все остановки справочника.
+// Вход - как у make_base вместе со stat_requests, база не сохраняется.
+void RunRouteBenchmark(std::istream& input, std::ostream& output) {
+    json::Document doc = json::Load(input);
+    json_reader::JsonReader reader(doc);
+
+    catalogue::TransportCatalogue cat;
+    catalogue::TransportRouter transport_router(reader.ReadRoutingSettings(doc), cat);
+    reader.Fill(cat, transport_router);
+    transport_router.Freeze();
+
+    const graph::DirectedWeightedGraph<BusRouteWeight>& graph = transport_router.GetRouteGraph<BusRouteWeight>();
+    const graph::DijkstraRouter<BusRouteWeight> dijkstra_router(graph, 0);
+    const graph::AStarRouter<BusRouteWeight> bidirectional_router(graph);
+    const graph::AStarRouter<BusRouteWeight> astar_router(graph, transport_router.GetTravelTimeLowerBound());
+
+    size_t route_count = 0;
+    size_t dijkstra_expanded = 0;
+    size_t bidirectional_expanded = 0;
+    size_t astar_expanded = 0;
+    size_t mismatches = 0;
+    std::vector<std::pair<const Stop*, const Stop*>> route_stops;
+    for (const json::Node& request : doc.GetRoot().AsDict().at("stat_requests"s).AsArray()) {
+        if (request.AsDict().at("type"s).AsString() != "Route"s) {
+            continue;
+        }
+        const graph::VertexId from = transport_router.GetStopVertexIndex(request.AsDict().at("from"s).AsString());
+        const graph::VertexId to = transport_router.GetStopVertexIndex(request.AsDict().at("to"s).AsString());
+        ++route_count;
+        route_stops.emplace_back(cat.FindStop(request.AsDict().at("from"s).AsString()),
+                                 cat.FindStop(request.AsDict().at("to"s).AsString()));
+
+        const auto tree = dijkstra_router.GetShortestPathTree(from);
+        dijkstra_expanded += std::count_if(tree->begin(), tree->end(),
+            [](const auto& route_data) { return route_data.has_value(); });
+
+        graph::AStarRouter<BusRouteWeight>::SearchStats stats;
+        const auto bidirectional_route = bidirectional_router.BuildRoute(from, to, &stats);
+        bidirectional_expanded += stats.expanded_vertices;
+        const auto astar_route = astar_router.BuildRoute(from, to, &stats);
+        astar_expanded += stats.expanded_vertices;
+
+        const auto& dijkstra_route = (*tree)[to];
+        if (dijkstra_route.has_value() != astar_route.has_value()
+            || bidirectional_route.has_value() != astar_route.has_value()
+            || (astar_route && (std::abs(dijkstra_route->weight.time - astar_route->weight.time) > 1e-6
+                                || std::abs(bidirectional_route->weight.time - astar_route->weight.time) > 1e-6))) {
+            ++mismatches;
+        }
+    }
+
+    // одинаковые запросы для обоих алгоритмов, без кеша деревьев путей
+    const catalogue::RaptorRouter raptor_router(cat, transport_router.GetRoutingSettings());
+    size_t raptor_mismatches = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::optional<double>> dijkstra_times;
+    for (const auto& [from, to] : route_stops) {
+        const auto tree = dijkstra_router.GetShortestPathTree(transport_router.GetStopVertexIndex(from->name_));
+        const auto& route = (*tree)[transport_router.GetStopVertexIndex(to->name_)];
+        dijkstra_times.push_back(route ? std::optional<double>(route->weight.time) : std::nullopt);
+    }
+    const auto dijkstra_duration = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < route_stops.size(); ++i) {
+        const auto journeys = raptor_router.FindJourneys(route_stops[i].first, route_stops[i].second);
+        if (journeys.empty() != !dijkstra_times[i].has_value()
+            || (!journeys.empty() && std::abs(journeys.back().total_time - *dijkstra_times[i]) > 1e-6)) {
+            ++raptor_mismatches;
+        }
+    }
+    const auto raptor_duration = std::chrono::steady_clock::now() - start;
+
+    // граница времени - медиана времен маршрутов входного файла, источники - первые
+    // различные остановки отправления
+    constexpr size_t REACHABLE_SOURCE_COUNT = 4;
+    std::vector<double> route_times;
+    for (const auto& time : dijkstra_times) {
+        if (time) {
+            route_times.push_back(*time);
+        }
+    }
+    BusRouteWeight max_weight;
+    if (!route_times.empty()) {
+        std::nth_element(route_times.begin(), route_times.begin() + route_times.size() / 2, route_times.end());
+        max_weight.time = route_times[route_times.size() / 2];
+    }
+    std::vector<graph::VertexId> reachable_sources;
+    for (const auto& [from, _] : route_stops) {
+        const graph::VertexId vertex = transport_router.GetStopVertexIndex(from->name_);
+        if (reachable_sources.size() < REACHABLE_SOURCE_COUNT
+            && std::find(reachable_sources.begin(), reachable_sources.end(), vertex) == reachable_sources.end()) {
+            reachable_sources.push_back(vertex);
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::pair<graph::VertexId, BusRouteWeight>>> reachable_vertices;
+    for (const graph::VertexId from : reachable_sources) {
+        reachable_vertices.push_back(dijkstra_router.GetReachableVertices(from, max_weight));
+    }
+    const auto reachable_duration = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::optional<double>>> batch_times;
+    for (const graph::VertexId from : reachable_sources) {
+        std::vector<std::optional<double>>& times = batch_times.emplace_back();
+        for (const Stop& stop : cat.GetStops()) {
+            const auto route = astar_router.BuildRoute(from, transport_router.GetStopVertexIndex(stop.name_));
+            times.push_back(route ? std::optional<double>(route->weight.time) : std::nullopt);
+        }
+    }
+    const auto batch_duration = std::chrono::steady_clock::now() - start;
+    size_t reachable_mismatches = 0;
+    for (size_t i = 0; i < reachable_sources.size(); ++i) {
+        std::vector<std::optional<double>> reachable_times(graph.GetVertexCount());
+        for (const auto& [vertex, weight] : reachable_vertices[i]) {
+            reachable_times[vertex] = weight.time;
+        }
+        for (const Stop& stop : cat.GetStops()) {
+            const auto& reachable_time = reachable_times[transport_router.GetStopVertexIndex(stop.name_)];
+            const auto& route_time = batch_times[i][stop.id];
+            // у границы времена могут разойтись на погрешность сложения
+            if (reachable_time ? !route_time || std::abs(*route_time - *reachable_time) > 1e-6
+                               : route_time && *route_time < max_weight.time - 1e-6) {
+                ++reachable_mismatches;
+            }
+        }
+    }
+
+    output << "routes: "sv << route_count << '\n';
+    output << "dijkstra expanded: "sv << dijkstra_expanded << '\n';
+    output << "bidirectional dijkstra expanded: "sv << bidirectional_expanded << '\n';
+    output << "bidirectional a* expanded: "sv << astar_expanded << '\n';
+    output << "weight mismatches: "sv << mismatches << '\n';
+    output << "dijkstra time, ms: "sv
+           << std::chrono::duration_cast<std::chrono::milliseconds>(dijkstra_duration).count() << '\n';
+    output << "raptor time, ms: "sv
+           << std::chrono::duration_cast<std::chrono::milliseconds>(raptor_duration).count() << '\n';
+    output << "raptor weight mismatches: "sv << raptor_mismatches << '\n';
+    output << "reachable sources: "sv << reachable_sources.size() << ", max time: "sv << max_weight.time << '\n';
+    output << "reachable time, ms: "sv
+           << std::chrono::duration_cast<std::chrono::milliseconds>(reachable_duration).count() << '\n';
+    output << "route batch time, ms: "sv
+           << std::chrono::duration_cast<std::chrono::milliseconds>(batch_duration).count() << '\n';
+    output << "reachable mismatches: "sv << reachable_mismatches << '\n';
+}
+
+// расписание строится, только если хотя бы у одного автобуса заданы отправления
+std::unique_ptr<catalogue::ConnectionScanRouter> MakeConnectionScanRouter(
+    const catalogue::TransportCatalogue& cat, const catalogue::RoutingSettings& settings) {
+    const auto& buses = cat.GetBuses();
+    if(std::none_of(buses.begin(), buses.end(), [](const Bus& bus) { return !bus.departures_.empty(); })) {
+        return nullptr;
+    }
+    return std::make_unique<catalogue::ConnectionScanRouter>(cat, settings.bus_velocity);
+}
+
+// иерархия нужна выбранному алгоритму или профилям весов
+bool NeedsCustomizableContractionHierarchy(const catalogue::RoutingSettings& settings) {
+    return settings.router_type == catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES
+        || !settings.profiles.empty();
+}
+
+// структуры поиска маршрута, сохраненные в базе; по указателям - чтобы ссылки
+// алгоритмов на граф переживали перемещение из std::future
+struct BaseRouting {
+    std::unique_ptr<catalogue::TransportRouter> transport_router;
+    std::unique_ptr<graph::Router<BusRouteWeight>> router;
+    std::unique_ptr<graph::MappedRouter<BusRouteWeight>> mapped_router;
+    std::unique_ptr<graph::ContractionHierarchy<BusRouteWeight>> contraction_hierarchy;
+    std::unique_ptr<graph::HubLabels<BusRouteWeight>> hub_labels;
+    std::unique_ptr<graph::CustomizableContractionHierarchy<BusRouteWeight>> customizable_contraction_hierarchy;
+    std::unique_ptr<catalogue::ConnectionScanRouter> connection_scan;
+};
+
+// Загружает только то, что нужно выбранному алгоритму. Не зависит от запросов -
+// может идти в фоне, пока они разбираются и на них отвечают.
+BaseRouting LoadBaseRouting(const Serialize::Deserializer& deserializer, const catalogue::TransportCatalogue& cat) {
+    BaseRouting result;
+    result.transport_router = std::make_unique<catalogue::TransportRouter>(deserializer.GetTransportRouter(cat));
+    const graph::DirectedWeightedGraph<BusRouteWeight>& graph = result.transport_router->GetRouteGraph<BusRouteWeight>();
+
+    const catalogue::RouterType router_type = result.transport_router->GetRoutingSettings().router_type;
+    if(router_type == catalogue::RouterType::ALL_PAIRS) {
+        // отдельный файл матрицы или раздел базы MAPPED не загружается, а отображается в память
+        if(deserializer.HasMappedRouter()) {
+            result.mapped_router = deserializer.GetMappedRouter(graph);
+        } else {
+            result.router = std::make_unique<graph::Router<BusRouteWeight>>(deserializer.GetRouter(graph));
+        }
+    } else if(router_type == catalogue::RouterType::CONTRACTION_HIERARCHIES) {
+        result.contraction_hierarchy = deserializer.GetContractionHierarchy(graph);
+    } else if(router_type == catalogue::RouterType::HUB_LABELS) {
+        result.hub_labels = deserializer.GetHubLabels(graph);
+    }
+    result.customizable_contraction_hierarchy = deserializer.GetCustomizableContractionHierarchy(graph);
+    result.connection_scan = deserializer.GetConnectionScanRouter(cat);
+    return result;
+}
+
+struct CommandLineOptions {
+    // число потоков построения графа и расчета матрицы маршрутов
+    size_t threads = 1;
+    // база для process_requests: открывается до чтения запросов, и структуры поиска
+    // маршрута загружаются в фоне, пока разбирается stdin
+    std::string base;
+};
+
+std::optional<CommandLineOptions> ParseOptions(int argc, char* argv[]) {
+    CommandLineOptions options;
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view option(argv[i]);
+        if (option == "--threads"sv && i + 1 < argc) {
+            const int threads = std::atoi(argv[++i]);
+            if (threads <= 0) {
+                return std::nullopt;
+            }
+            options.threads = static_cast<size_t>(threads);
+        } else if (option == "--base"sv && i + 1 < argc) {
+            options.base = argv[++i];
+        } else {
+            return std::nullopt;
+        }
+    }
+    return options;
 }
 
 int main(int argc, char* argv[]) {
-     if (argc != 2) {
+    if (argc < 2) {
         PrintUsage();
         return 1;
     }
 
     const std::string_view mode(argv[1]);
+    const std::optional<CommandLineOptions> options = ParseOptions(argc, argv);
+    if (!options) {
+        PrintUsage();
+        return 1;
+    }
 
      if (mode == "make_base"sv) {
         {
@@ -36,8 +280,35 @@ int main(int argc, char* argv[]) {
                 reader.ReadRoutingSettings(doc), 
                 cat);
             // заполнение справочника и роутера
-            reader.Fill(cat, transport_router);
-            graph::Router<BusRouteWeight> router(transport_router.GetRouteGraph<BusRouteWeight>());
+            reader.Fill(cat, transport_router, options->threads);
+            const size_t pruned_edge_count = transport_router.PruneDominatedEdges();
+            std::cerr << "Pruned dominated edges: "sv << pruned_edge_count << '\n';
+            // до заморозки: CSR строится уже в новой нумерации вершин
+            transport_router.RenumberVertices();
+            transport_router.Freeze();
+
+            // рассчитываются только структуры, нужные выбранному алгоритму
+            const catalogue::RouterType router_type = transport_router.GetRoutingSettings().router_type;
+            std::optional<graph::Router<BusRouteWeight>> router;
+            std::unique_ptr<graph::ContractionHierarchy<BusRouteWeight>> contraction_hierarchy;
+            std::unique_ptr<graph::HubLabels<BusRouteWeight>> hub_labels;
+            if(router_type == catalogue::RouterType::ALL_PAIRS) {
+                router.emplace(transport_router.GetRouteGraph<BusRouteWeight>(), options->threads);
+            } else if(router_type == catalogue::RouterType::CONTRACTION_HIERARCHIES) {
+                contraction_hierarchy = std::make_unique<graph::ContractionHierarchy<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            } else if(router_type == catalogue::RouterType::HUB_LABELS) {
+                hub_labels = std::make_unique<graph::HubLabels<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            }
+
+            // порядок вершин и ярлыки не зависят от весов - веса настраиваются при загрузке
+            std::unique_ptr<graph::CustomizableContractionHierarchy<BusRouteWeight>> customizable_contraction_hierarchy;
+            if(NeedsCustomizableContractionHierarchy(transport_router.GetRoutingSettings())) {
+                customizable_contraction_hierarchy = std::make_unique<graph::CustomizableContractionHierarchy<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            }
+            const auto connection_scan = MakeConnectionScanRouter(cat, transport_router.GetRoutingSettings());
 
             //renderer::MapRenderer renderer(reader.GetRenderSettings(), cat.GetBusesSorted());
 
@@ -48,38 +319,162 @@ int main(int argc, char* argv[]) {
                 transport_router,
                 reader.GetRenderSettings(),
                 reader.ReadSerializeSettings(doc),
-                router
+                catalogue::RoutingIndexes{router ? &*router : nullptr, nullptr, contraction_hierarchy.get(), hub_labels.get(),
+                                          customizable_contraction_hierarchy.get(), connection_scan.get()}
             );
             serializer_2000.Save();
         }
 
-    } else if (mode == "process_requests"sv) {
+    } else if (mode == "update_base"sv) {
         {
-            // process requests here
+            // дополнение существующей базы новыми остановками и автобусами
             json::Document doc = json::Load(std::cin);
 
             json_reader::JsonReader reader(doc);
 
-            Serialize::Deserializer deserializer(reader.ReadSerializeSettings(doc));
+            Serialize::SerializeSettings serialize_settings = reader.ReadSerializeSettings(doc);
+            Serialize::Deserializer deserializer(serialize_settings);
+            // матрица, сохраненная в отдельный файл, туда же и перезаписывается
+            if(serialize_settings.router_file.empty()) {
+                if(const auto routes_file = deserializer.GetRoutesFile()) {
+                    serialize_settings.router_file = routes_file->string();
+                }
+            }
+            if(!serialize_settings.format) {
+                serialize_settings.format = deserializer.IsMappedBase()
+                    ? Serialize::BaseFormat::MAPPED
+                    : Serialize::BaseFormat::PROTOBUF;
+            }
 
             catalogue::TransportCatalogue cat = deserializer.GetTransportCatalogue();
 
             catalogue::TransportRouter transport_router = deserializer.GetTransportRouter(cat);
 
-            renderer::MapRenderer renderer(
-                deserializer.GetRenderSettings(), 
-                cat.GetBusesSorted());
+            const catalogue::RouterType router_type = transport_router.GetRoutingSettings().router_type;
+            std::optional<graph::Router<BusRouteWeight>> router;
+            if(router_type == catalogue::RouterType::ALL_PAIRS) {
+                router.emplace(deserializer.GetRouter(transport_router.GetRouteGraph<BusRouteWeight>()));
+            }
+
+            // новые вершины и ребра дописываются после существующих
+            transport_router.Unfreeze();
+            const graph::EdgeId first_new_edge = transport_router.GetRouteGraph<BusRouteWeight>().GetEdgeCount();
+            reader.Fill(cat, transport_router, options->threads);
+
+            // матрица маршрутов дополняется только через новые ребра
+            if(router) {
+                router->AddEdges(first_new_edge);
+            }
+            const std::vector<graph::EdgeId> new_to_old = transport_router.Freeze();
+            if(router) {
+                router->RenumberEdges(new_to_old);
+            }
+
+            // иерархии сжатия и метки хабов не дополняются - строятся заново
+            std::unique_ptr<graph::ContractionHierarchy<BusRouteWeight>> contraction_hierarchy;
+            std::unique_ptr<graph::HubLabels<BusRouteWeight>> hub_labels;
+            if(router_type == catalogue::RouterType::CONTRACTION_HIERARCHIES) {
+                contraction_hierarchy = std::make_unique<graph::ContractionHierarchy<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            } else if(router_type == catalogue::RouterType::HUB_LABELS) {
+                hub_labels = std::make_unique<graph::HubLabels<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            }
+            std::unique_ptr<graph::CustomizableContractionHierarchy<BusRouteWeight>> customizable_contraction_hierarchy;
+            if(NeedsCustomizableContractionHierarchy(transport_router.GetRoutingSettings())) {
+                customizable_contraction_hierarchy = std::make_unique<graph::CustomizableContractionHierarchy<BusRouteWeight>>(
+                    transport_router.GetRouteGraph<BusRouteWeight>());
+            }
+            // связи новых рейсов встают в середину упорядоченного массива - он строится заново
+            const auto connection_scan = MakeConnectionScanRouter(cat, transport_router.GetRoutingSettings());
+
+            Serialize::Serializer serializer(
+                cat,
+                transport_router,
+                deserializer.GetRenderSettings(),
+                serialize_settings,
+                catalogue::RoutingIndexes{router ? &*router : nullptr, nullptr, contraction_hierarchy.get(), hub_labels.get(),
+                                          customizable_contraction_hierarchy.get(), connection_scan.get()}
+            );
+            serializer.Save();
+        }
+
+    } else if (mode == "process_requests"sv) {
+        {
+            // process requests here
+            std::optional<Serialize::Deserializer> deserializer;
+            std::optional<catalogue::TransportCatalogue> cat;
+            std::future<BaseRouting> base_routing;
+            // background - загрузка в отдельном потоке, иначе - при первом запросе маршрута.
+            // На одном ядре фоновому потоку не с чем идти одновременно - он только мешает.
+            const auto open_base = [&](const std::filesystem::path& path, bool background) {
+                deserializer.emplace(path);
+                cat.emplace(deserializer->GetTransportCatalogue());
+                const bool async = background && std::thread::hardware_concurrency() > 1;
+                base_routing = std::async(async ? std::launch::async : std::launch::deferred,
+                                          LoadBaseRouting, std::cref(*deserializer), std::cref(*cat));
+            };
+            if (!options->base.empty()) {
+                open_base(options->base, true);
+            }
+
+            json::Document doc = json::Load(std::cin);
+
+            json_reader::JsonReader reader(doc);
+
+            if (!deserializer) {
+                // фоновая загрузка нужна, только если ее дождется запрос маршрута:
+                // иначе выход из программы ждал бы ее впустую
+                open_base(reader.ReadSerializeSettings(doc).file, reader.HasRoutingRequests(doc));
+            }
+
+            // визуализатор загружается из базы при первом запросе карты
+            std::optional<renderer::MapRenderer> renderer;
+            const auto load_renderer = [&]() -> renderer::MapRenderer& {
+                renderer.emplace(deserializer->GetRenderSettings(), cat->GetBusesSorted());
+                return *renderer;
+            };
 
-            graph::Router<BusRouteWeight> router = deserializer.GetRouter(transport_router.GetRouteGraph<BusRouteWeight>());
+            // первый запрос маршрута ждет окончания загрузки
+            BaseRouting routing;
+            const auto load_routing = [&]() {
+                routing = base_routing.get();
+                const graph::DirectedWeightedGraph<BusRouteWeight>& graph = routing.transport_router->GetRouteGraph<BusRouteWeight>();
 
-            RequestHandler handler(cat, renderer, router, transport_router);
+                // профили запроса дополняют профили базы: иерархия только настраивается под их веса
+                catalogue::RoutingSettings routing_settings = routing.transport_router->GetRoutingSettings();
+                for(auto& [name, profile] : reader.ReadRoutingProfiles(doc)) {
+                    routing_settings.profiles[name] = profile;
+                }
+                routing.transport_router->SetRoutingSettings(routing_settings);
+                if(!routing.customizable_contraction_hierarchy && NeedsCustomizableContractionHierarchy(routing_settings)) {
+                    routing.customizable_contraction_hierarchy = std::make_unique<graph::CustomizableContractionHierarchy<BusRouteWeight>>(graph);
+                }
+
+                return RoutingContext{*routing.transport_router,
+                    catalogue::RoutingIndexes{routing.router.get(), routing.mapped_router.get(), routing.contraction_hierarchy.get(),
+                                              routing.hub_labels.get(), routing.customizable_contraction_hierarchy.get(),
+                                              routing.connection_scan.get()}};
+            };
+
+            RequestHandler handler(*cat, load_renderer, load_routing);
 
             json::Document result = reader.ProcessStatRequests(handler);
 
 
             json::Print(result, std::cout);
+            std::cout.flush();
+
+            if (base_routing.valid()) {
+                // загрузку, которую не дождался ни один запрос, не ждать при выходе:
+                // деструктор std::future из std::async ждет ее окончания
+                deserializer->CancelLoading();
+            }
         }
 
+    } else if (mode == "benchmark"sv) {
+        RunRouteBenchmark(std::cin, std::cout);
+
     } else {
          PrintUsage();
          return 1;
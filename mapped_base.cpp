@@ -0,0 +1,365 @@
+#include "mapped_base.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace Serialize {
+
+namespace {
+
+// раздел - с выровненного смещения, размер - по фактически записанному
+class SectionWriter {
+public:
+    explicit SectionWriter(std::ofstream& out)
+        : out_(out) {
+        // место под заголовок и таблицу всех возможных разделов - заполняется в конце
+        const std::vector<char> zeros(sizeof(MappedBaseHeader) + MAX_SECTION_COUNT * sizeof(MappedBaseSection), 0);
+        out_.write(zeros.data(), zeros.size());
+    }
+
+    void Begin(MappedBaseSectionId id) {
+        const uint64_t position = static_cast<uint64_t>(out_.tellp());
+        const uint64_t padding = (MAPPED_BASE_SECTION_ALIGNMENT - position % MAPPED_BASE_SECTION_ALIGNMENT)
+            % MAPPED_BASE_SECTION_ALIGNMENT;
+        const std::vector<char> zeros(padding, 0);
+        out_.write(zeros.data(), zeros.size());
+        sections_.push_back({id, 0, position + padding, 0});
+    }
+
+    void End() {
+        sections_.back().size = static_cast<uint64_t>(out_.tellp()) - sections_.back().offset;
+    }
+
+    template <typename T>
+    void WriteRecords(MappedBaseSectionId id, const std::vector<T>& records) {
+        Begin(id);
+        out_.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+        End();
+    }
+
+    void WriteBytes(MappedBaseSectionId id, std::string_view bytes) {
+        Begin(id);
+        out_.write(bytes.data(), bytes.size());
+        End();
+    }
+
+    void Finish() {
+        MappedBaseHeader header{};
+        std::memcpy(header.magic, MAPPED_BASE_MAGIC, sizeof(header.magic));
+        header.version = MAPPED_BASE_VERSION;
+        header.section_count = static_cast<uint32_t>(sections_.size());
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_.write(reinterpret_cast<const char*>(sections_.data()), sections_.size() * sizeof(MappedBaseSection));
+    }
+
+private:
+    static constexpr size_t MAX_SECTION_COUNT = static_cast<size_t>(MappedBaseSectionId::PROTOBUF) + 1;
+
+    std::ofstream& out_;
+    std::vector<MappedBaseSection> sections_;
+};
+
+} // namespace
+
+void WriteMappedBase(const std::filesystem::path& path,
+                     const catalogue::TransportCatalogue& catalogue,
+                     const catalogue::TransportRouter& transport_router,
+                     const graph::Router<BusRouteWeight>* router,
+                     std::string_view protobuf_section) {
+    const graph::DirectedWeightedGraph<BusRouteWeight>& route_graph = transport_router.GetRouteGraph<BusRouteWeight>();
+    if(!route_graph.IsFrozen()) {
+        throw std::logic_error("Route graph must be frozen to be saved in mapped base");
+    }
+
+    std::string strings;
+    std::vector<MappedStop> stops;
+    stops.reserve(catalogue.GetStops().size());
+    for(const Stop& stop : catalogue.GetStops()) {
+        stops.push_back({strings.size(), stop.name_.size(), stop.cordinates_.lat, stop.cordinates_.lng});
+        strings += stop.name_;
+    }
+
+    std::vector<MappedBus> buses;
+    std::vector<uint32_t> bus_stops;
+    std::vector<double> departures;
+    buses.reserve(catalogue.GetBuses().size());
+    for(const Bus& bus : catalogue.GetBuses()) {
+        buses.push_back({
+            strings.size(), bus.name_.size(),
+            bus_stops.size(), bus.stops_.size(),
+            departures.size(), bus.departures_.size(),
+            bus.bus_type_ == BusType::CYCLED ? 1u : 0u, 0
+        });
+        strings += bus.name_;
+        for(const Stop* stop : bus.stops_) {
+            bus_stops.push_back(static_cast<uint32_t>(stop->id));
+        }
+        departures.insert(departures.end(), bus.departures_.begin(), bus.departures_.end());
+    }
+
+    // порядок хеш-таблицы не переносится в файл - одна и та же база дает один и тот же файл
+    std::vector<MappedDistance> distances;
+    distances.reserve(catalogue.GetIntervalsToDistance().size());
+    for(const auto& [interval, distance] : catalogue.GetIntervalsToDistance()) {
+        distances.push_back({static_cast<uint32_t>(interval.first->id), static_cast<uint32_t>(interval.second->id), distance});
+    }
+    std::sort(distances.begin(), distances.end(), [](const MappedDistance& lhs, const MappedDistance& rhs) {
+        return lhs.from != rhs.from ? lhs.from < rhs.from : lhs.to < rhs.to;
+    });
+
+    std::vector<MappedEdge> edges;
+    edges.reserve(route_graph.GetEdgeCount());
+    for(const graph::Edge<BusRouteWeight>& edge : route_graph.GetEdges()) {
+        edges.push_back({
+            static_cast<uint32_t>(edge.from), static_cast<uint32_t>(edge.to),
+            edge.weight.time, edge.weight.span, 0
+        });
+    }
+    const std::vector<uint64_t> offsets(route_graph.GetIncidenceOffsets().begin(), route_graph.GetIncidenceOffsets().end());
+
+    std::vector<uint32_t> vertex_stops;
+    vertex_stops.reserve(transport_router.GetVertexIndexToStop().size());
+    for(const Stop* stop : transport_router.GetVertexIndexToStop()) {
+        vertex_stops.push_back(static_cast<uint32_t>(stop->id));
+    }
+    std::vector<uint32_t> edge_buses;
+    edge_buses.reserve(transport_router.GetEdgeIndexToBus().size());
+    for(const Bus* bus : transport_router.GetEdgeIndexToBus()) {
+        edge_buses.push_back(bus ? static_cast<uint32_t>(bus->id) : MAPPED_BASE_NO_BUS);
+    }
+
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if(!out) {
+            throw std::runtime_error("Can't create base file " + temp_path.string());
+        }
+        SectionWriter writer(out);
+        writer.WriteBytes(MappedBaseSectionId::STRINGS, strings);
+        writer.WriteRecords(MappedBaseSectionId::STOPS, stops);
+        writer.WriteRecords(MappedBaseSectionId::BUSES, buses);
+        writer.WriteRecords(MappedBaseSectionId::BUS_STOPS, bus_stops);
+        writer.WriteRecords(MappedBaseSectionId::DEPARTURES, departures);
+        writer.WriteRecords(MappedBaseSectionId::DISTANCES, distances);
+        writer.WriteRecords(MappedBaseSectionId::GRAPH_EDGES, edges);
+        writer.WriteRecords(MappedBaseSectionId::GRAPH_OFFSETS, offsets);
+        writer.WriteRecords(MappedBaseSectionId::VERTEX_STOPS, vertex_stops);
+        writer.WriteRecords(MappedBaseSectionId::EDGE_BUSES, edge_buses);
+        if(!transport_router.GetEdgeIndexToRideTime().empty()) {
+            writer.WriteRecords(MappedBaseSectionId::EDGE_RIDE_TIMES, transport_router.GetEdgeIndexToRideTime());
+        }
+        if(router) {
+            writer.Begin(MappedBaseSectionId::ROUTER);
+            graph::WriteRoutesData(out, router->GetRoutesInternalData());
+            writer.End();
+        }
+        writer.WriteBytes(MappedBaseSectionId::PROTOBUF, protobuf_section);
+        writer.Finish();
+        if(!out) {
+            throw std::runtime_error("Can't write base file " + temp_path.string());
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+MappedBase::MappedBase(const std::filesystem::path& path)
+    : file_(std::make_shared<const graph::MappedFile>(path)) {
+    MappedBaseHeader header{};
+    if(file_->GetSize() < sizeof(header)) {
+        throw std::runtime_error("Bad base file");
+    }
+    std::memcpy(&header, file_->GetData(), sizeof(header));
+    if(std::memcmp(header.magic, MAPPED_BASE_MAGIC, sizeof(header.magic)) != 0
+       || header.version != MAPPED_BASE_VERSION
+       || file_->GetSize() < sizeof(header) + header.section_count * sizeof(MappedBaseSection)) {
+        throw std::runtime_error("Bad base file");
+    }
+    sections_.resize(header.section_count);
+    std::memcpy(sections_.data(), file_->GetData() + sizeof(header), sections_.size() * sizeof(MappedBaseSection));
+    for(const MappedBaseSection& section : sections_) {
+        if(section.offset % MAPPED_BASE_SECTION_ALIGNMENT != 0 || section.offset + section.size > file_->GetSize()) {
+            throw std::runtime_error("Bad base file");
+        }
+    }
+}
+
+bool MappedBase::IsMappedBase(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(MAPPED_BASE_MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, MAPPED_BASE_MAGIC, sizeof(magic)) == 0;
+}
+
+const MappedBaseSection* MappedBase::FindSection(MappedBaseSectionId id) const {
+    const auto it = std::find_if(sections_.begin(), sections_.end(),
+                                 [id](const MappedBaseSection& section) { return section.id == id; });
+    return it == sections_.end() ? nullptr : &*it;
+}
+
+template <typename T>
+std::pair<const T*, size_t> MappedBase::GetRecords(MappedBaseSectionId id) const {
+    const MappedBaseSection* section = FindSection(id);
+    if(!section) {
+        return {nullptr, 0};
+    }
+    if(section->size % sizeof(T) != 0) {
+        throw std::runtime_error("Bad base file");
+    }
+    return {reinterpret_cast<const T*>(file_->GetData() + section->offset), section->size / sizeof(T)};
+}
+
+catalogue::TransportCatalogue MappedBase::GetTransportCatalogue() const {
+    catalogue::TransportCatalogue result;
+
+    const auto [strings, strings_size] = GetRecords<char>(MappedBaseSectionId::STRINGS);
+    const auto get_string = [strings = strings, strings_size = strings_size](uint64_t offset, uint64_t size) {
+        if(offset + size > strings_size) {
+            throw std::runtime_error("Bad base file");
+        }
+        return std::string(strings + offset, size);
+    };
+
+    {
+        // остановки
+        const auto [mapped_stops, stop_count] = GetRecords<MappedStop>(MappedBaseSectionId::STOPS);
+        std::deque<Stop> stops;
+        std::map<std::string_view, const Stop*> stopname_to_stop;
+        for(size_t stop_id = 0; stop_id < stop_count; ++stop_id) {
+            const MappedStop& mapped_stop = mapped_stops[stop_id];
+            Stop& emplaced = stops.emplace_back(Stop{
+                get_string(mapped_stop.name_offset, mapped_stop.name_size),
+                geo::Coordinates{mapped_stop.lat, mapped_stop.lng},
+                static_cast<int>(stop_id)
+            });
+            stopname_to_stop[std::string_view(emplaced.name_)] = &emplaced;
+        }
+        result.SetStops(std::move(stops));
+        result.SetStopnameToStop(std::move(stopname_to_stop));
+    }
+    {
+        // автобусы и stops_to_buses_ - по их остановкам
+        const auto [mapped_buses, bus_count] = GetRecords<MappedBus>(MappedBaseSectionId::BUSES);
+        const auto [bus_stops, bus_stop_count] = GetRecords<uint32_t>(MappedBaseSectionId::BUS_STOPS);
+        const auto [departures, departure_count] = GetRecords<double>(MappedBaseSectionId::DEPARTURES);
+        std::deque<Bus> buses;
+        std::map<std::string_view, const Bus*> busname_to_bus;
+        for(size_t bus_id = 0; bus_id < bus_count; ++bus_id) {
+            const MappedBus& mapped_bus = mapped_buses[bus_id];
+            if(mapped_bus.stops_offset + mapped_bus.stop_count > bus_stop_count
+               || mapped_bus.departures_offset + mapped_bus.departure_count > departure_count) {
+                throw std::runtime_error("Bad base file");
+            }
+            std::vector<const Stop*> stops;
+            stops.reserve(mapped_bus.stop_count);
+            for(size_t i = 0; i < mapped_bus.stop_count; ++i) {
+                stops.push_back(&result.GetStops().at(bus_stops[mapped_bus.stops_offset + i]));
+            }
+            Bus& emplaced = buses.emplace_back(Bus{
+                get_string(mapped_bus.name_offset, mapped_bus.name_size),
+                std::move(stops),
+                mapped_bus.cycled ? BusType::CYCLED : BusType::ORDINARY,
+                static_cast<int>(bus_id),
+                std::vector<double>(departures + mapped_bus.departures_offset,
+                                    departures + mapped_bus.departures_offset + mapped_bus.departure_count)
+            });
+            busname_to_bus[std::string_view(emplaced.name_)] = &emplaced;
+        }
+        result.SetBuses(std::move(buses));
+        result.SetBusnameToBus(std::move(busname_to_bus));
+
+        std::unordered_map<const Stop*, std::set<const Bus*>> stops_to_buses;
+        for(const Bus& bus : result.GetBuses()) {
+            for(const Stop* stop : bus.stops_) {
+                stops_to_buses[stop].insert(&bus);
+            }
+        }
+        result.SetStopsToBuses(std::move(stops_to_buses));
+    }
+    {
+        // intervals_to_distance_
+        const auto [distances, distance_count] = GetRecords<MappedDistance>(MappedBaseSectionId::DISTANCES);
+        std::unordered_map<std::pair<const Stop*, const Stop*>, uint64_t, catalogue::RouteDistanceHasher> intervals_to_distance;
+        intervals_to_distance.reserve(distance_count);
+        for(size_t i = 0; i < distance_count; ++i) {
+            intervals_to_distance[{&result.GetStops().at(distances[i].from), &result.GetStops().at(distances[i].to)}]
+                = distances[i].distance;
+        }
+        result.SetIntervalsToDistance(std::move(intervals_to_distance));
+    }
+    return result;
+}
+
+void MappedBase::FillTransportRouter(const catalogue::TransportCatalogue& catalogue,
+                                     catalogue::TransportRouter& transport_router) const {
+    const auto [vertex_stops, vertex_count] = GetRecords<uint32_t>(MappedBaseSectionId::VERTEX_STOPS);
+    std::deque<const Stop*> vertex_index_to_stop;
+    std::map<std::string_view, graph::VertexId> stopname_to_vertex_id;
+    for(graph::VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        const Stop* stop = vertex_index_to_stop.emplace_back(&catalogue.GetStops().at(vertex_stops[vertex]));
+        // первая вершина остановки - "приемная" (или единственная)
+        stopname_to_vertex_id.emplace(stop->name_, vertex);
+    }
+
+    const auto [edge_buses, edge_count] = GetRecords<uint32_t>(MappedBaseSectionId::EDGE_BUSES);
+    std::vector<const Bus*> edge_index_to_bus;
+    edge_index_to_bus.reserve(edge_count);
+    for(graph::EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        edge_index_to_bus.push_back(edge_buses[edge_id] == MAPPED_BASE_NO_BUS
+            ? nullptr
+            : &catalogue.GetBuses().at(edge_buses[edge_id]));
+    }
+
+    const auto [ride_times, ride_time_count] = GetRecords<double>(MappedBaseSectionId::EDGE_RIDE_TIMES);
+    if(transport_router.GetRoutingSettings().graph_model == catalogue::GraphModel::SINGLE_VERTEX
+        && ride_time_count != edge_count) {
+        throw std::runtime_error("Bad base file");
+    }
+
+    const auto [mapped_edges, mapped_edge_count] = GetRecords<MappedEdge>(MappedBaseSectionId::GRAPH_EDGES);
+    const auto [offsets, offset_count] = GetRecords<uint64_t>(MappedBaseSectionId::GRAPH_OFFSETS);
+    std::vector<graph::Edge<BusRouteWeight>> edges;
+    edges.reserve(mapped_edge_count);
+    for(size_t i = 0; i < mapped_edge_count; ++i) {
+        BusRouteWeight weight;
+        weight.time = mapped_edges[i].time;
+        weight.span = mapped_edges[i].span;
+        edges.push_back({mapped_edges[i].from, mapped_edges[i].to, weight});
+    }
+    if(offset_count != vertex_count + 1 || mapped_edge_count != edge_count) {
+        throw std::runtime_error("Bad base file");
+    }
+
+    transport_router.SetVertexIndexToStop(std::move(vertex_index_to_stop));
+    transport_router.SetStopnameToVertexId(std::move(stopname_to_vertex_id));
+    transport_router.SetEdgeIndexToBus(std::move(edge_index_to_bus));
+    transport_router.SetEdgeIndexToRideTime(std::vector<double>(ride_times, ride_times + ride_time_count));
+    transport_router.SetRouteGraph(graph::DirectedWeightedGraph<BusRouteWeight>(
+        std::move(edges), std::vector<graph::EdgeId>(offsets, offsets + offset_count)));
+}
+
+bool MappedBase::HasRoutes() const {
+    return FindSection(MappedBaseSectionId::ROUTER) != nullptr;
+}
+
+graph::MappedRoutesMatrix<BusRouteWeight> MappedBase::GetRoutesMatrix() const {
+    const MappedBaseSection* section = FindSection(MappedBaseSectionId::ROUTER);
+    if(!section) {
+        throw std::logic_error("Routes matrix is not stored in the base");
+    }
+    return graph::MappedRoutesMatrix<BusRouteWeight>(file_, section->offset, section->size);
+}
+
+std::string_view MappedBase::GetProtobufSection() const {
+    const auto [data, size] = GetRecords<char>(MappedBaseSectionId::PROTOBUF);
+    return {data, size};
+}
+
+} // namespace Serialize
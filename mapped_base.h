@@ -0,0 +1,147 @@
+#pragma once
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+#include "routes_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Serialize {
+
+// База для отображения в память (SerializeSettings::format == BaseFormat::MAPPED).
+// Справочник, граф и матрица маршрутов лежат массивами записей фиксированного размера,
+// и загрузка - это mmap и проход по массивам без разбора protobuf. Матрица по всем парам
+// не копируется вовсе: MappedRoutesMatrix читает строки прямо из отображения.
+// Остальное (настройки, иерархии, метки, расписание) невелико и хранится
+// в разделе PROTOBUF как tc_pb::TransportBase без справочника, графа и матрицы.
+//
+// Формат (порядок байт - как у машины, создавшей базу):
+//   MappedBaseHeader
+//   MappedBaseSection[section_count]
+//   разделы, каждый выровнен по MAPPED_BASE_SECTION_ALIGNMENT
+enum class MappedBaseSectionId : uint32_t {
+    // имена остановок и автобусов подряд, без разделителей
+    STRINGS,
+    // MappedStop, index = Stop::id
+    STOPS,
+    // MappedBus, index = Bus::id
+    BUSES,
+    // uint32_t Stop::id остановок автобусов подряд
+    BUS_STOPS,
+    // double - отправления автобусов подряд
+    DEPARTURES,
+    // MappedDistance
+    DISTANCES,
+    // MappedEdge, index = EdgeId, упорядочены по from (CSR)
+    GRAPH_EDGES,
+    // uint64_t, ребра вершины v - [offsets[v], offsets[v + 1])
+    GRAPH_OFFSETS,
+    // uint32_t Stop::id, index = VertexId
+    VERTEX_STOPS,
+    // uint32_t Bus::id или MAPPED_BASE_NO_BUS, index = EdgeId
+    EDGE_BUSES,
+    // данные graph::WriteRoutesData (только RouterType::ALL_PAIRS)
+    ROUTER,
+    // сериализованный tc_pb::TransportBase с остальными структурами
+    PROTOBUF,
+    // double - время поездки без ожидания, index = EdgeId (только GraphModel::SINGLE_VERTEX)
+    EDGE_RIDE_TIMES,
+};
+
+struct MappedBaseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+};
+
+struct MappedBaseSection {
+    MappedBaseSectionId id;
+    uint32_t reserved;
+    // от начала файла
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MappedStop {
+    // имя - [name_offset, name_offset + name_size) раздела STRINGS
+    uint64_t name_offset;
+    uint64_t name_size;
+    double lat;
+    double lng;
+};
+
+struct MappedBus {
+    uint64_t name_offset;
+    uint64_t name_size;
+    // остановки - [stops_offset, stops_offset + stop_count) раздела BUS_STOPS
+    uint64_t stops_offset;
+    uint64_t stop_count;
+    uint64_t departures_offset;
+    uint64_t departure_count;
+    uint32_t cycled;
+    uint32_t reserved;
+};
+
+struct MappedDistance {
+    uint32_t from;
+    uint32_t to;
+    uint64_t distance;
+};
+
+struct MappedEdge {
+    uint32_t from;
+    uint32_t to;
+    double time;
+    int32_t span;
+    uint32_t reserved;
+};
+
+inline constexpr char MAPPED_BASE_MAGIC[8] = {'T', 'C', 'M', 'A', 'P', 'B', 'A', 'S'};
+inline constexpr uint32_t MAPPED_BASE_VERSION = 1;
+inline constexpr size_t MAPPED_BASE_SECTION_ALIGNMENT = graph::ROUTES_FILE_RECORDS_ALIGNMENT;
+inline constexpr uint32_t MAPPED_BASE_NO_BUS = UINT32_MAX;
+
+// Записывает базу под временным именем и переименовывает: процессы, отобразившие
+// прежнюю базу, ее дочитывают. router - матрица по всем парам или nullptr,
+// protobuf_section - сериализованный tc_pb::TransportBase с остальными структурами.
+void WriteMappedBase(const std::filesystem::path& path,
+                     const catalogue::TransportCatalogue& catalogue,
+                     const catalogue::TransportRouter& transport_router,
+                     const graph::Router<BusRouteWeight>* router,
+                     std::string_view protobuf_section);
+
+class MappedBase {
+public:
+    explicit MappedBase(const std::filesystem::path& path);
+
+    // файл начинается с MAPPED_BASE_MAGIC
+    static bool IsMappedBase(const std::filesystem::path& path);
+
+    catalogue::TransportCatalogue GetTransportCatalogue() const;
+    // заполняет граф и соответствия вершина -> остановка, ребро -> автобус
+    void FillTransportRouter(const catalogue::TransportCatalogue& catalogue,
+                             catalogue::TransportRouter& transport_router) const;
+
+    bool HasRoutes() const;
+    // матрица читается из отображения базы, копии нет
+    graph::MappedRoutesMatrix<BusRouteWeight> GetRoutesMatrix() const;
+
+    std::string_view GetProtobufSection() const;
+
+private:
+    const MappedBaseSection* FindSection(MappedBaseSectionId id) const;
+    // записи раздела; отсутствующий раздел - пустой
+    template <typename T>
+    std::pair<const T*, size_t> GetRecords(MappedBaseSectionId id) const;
+
+    std::shared_ptr<const graph::MappedFile> file_;
+    std::vector<MappedBaseSection> sections_;
+};
+
+} // namespace Serialize
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+#include "routes_file.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Маршрутизатор по всем парам, матрица которого не загружается в память,
+// а читается из отображенного файла (см. routes_file.h).
+// Маршрут from -> to восстанавливается только по строке from.
+template <typename Weight>
+class MappedRouter {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using RoutesInternalData = MappedRoutesMatrix<Weight>;
+
+    MappedRouter(const Graph& graph, const std::filesystem::path& routes_file);
+    // матрица - раздел уже отображенного файла (см. mapped_base.h)
+    MappedRouter(const Graph& graph, RoutesInternalData&& routes_internal_data);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    const RoutesInternalData& GetRoutesInternalData() const;
+
+private:
+    const Graph& graph_;
+    RoutesInternalData routes_internal_data_;
+};
+
+template <typename Weight>
+MappedRouter<Weight>::MappedRouter(const Graph& graph, const std::filesystem::path& routes_file)
+    : MappedRouter(graph, RoutesInternalData(routes_file))
+{
+}
+
+template <typename Weight>
+MappedRouter<Weight>::MappedRouter(const Graph& graph, RoutesInternalData&& routes_internal_data)
+    : graph_(graph)
+    , routes_internal_data_(std::move(routes_internal_data))
+{
+    if (routes_internal_data_.GetVertexCount() != graph_.GetVertexCount()) {
+        throw std::runtime_error("Routes file doesn't match route graph");
+    }
+}
+
+template <typename Weight>
+std::optional<typename MappedRouter<Weight>::RouteInfo> MappedRouter<Weight>::BuildRoute(VertexId from,
+                                                                                         VertexId to) const {
+    if (from >= routes_internal_data_.GetVertexCount() || to >= routes_internal_data_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    if (!routes_internal_data_.IsReachable(from, to)) {
+        return std::nullopt;
+    }
+    const Weight weight = routes_internal_data_.GetWeight(from, to);
+    std::vector<EdgeId> edges;
+    for (std::optional<EdgeId> edge_id = routes_internal_data_.GetPrevEdge(from, to);
+         edge_id;
+         edge_id = routes_internal_data_.GetPrevEdge(from, graph_.GetEdge(*edge_id).from))
+    {
+        edges.push_back(*edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{weight, std::move(edges)};
+}
+
+template <typename Weight>
+const typename MappedRouter<Weight>::RoutesInternalData&
+MappedRouter<Weight>::GetRoutesInternalData() const {
+    return routes_internal_data_;
+}
+
+}  // namespace graph
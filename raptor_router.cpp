@@ -0,0 +1,174 @@
+#include "raptor_router.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace catalogue {
+
+RaptorRouter::RaptorRouter(const TransportCatalogue& cat, const RoutingSettings& settings)
+    : cat_(cat)
+    , bus_wait_time_(settings.bus_wait_time)
+    , bus_velocity_(settings.bus_velocity) {
+
+    // направления - как ребра графа маршрутов: кольцевой автобус в одну сторону,
+    // обычный - туда и обратно
+    for(const Bus& bus : cat_.GetBuses()) {
+        std::vector<uint32_t> stops;
+        stops.reserve(bus.stops_.size());
+        for(const Stop* stop : bus.stops_) {
+            stops.push_back(static_cast<uint32_t>(stop->id));
+        }
+        if(bus.bus_type_ == BusType::CYCLED) {
+            AddPattern(&bus, std::move(stops));
+        } else {
+            std::vector<uint32_t> reversed_stops(stops.rbegin(), stops.rend());
+            AddPattern(&bus, std::move(stops));
+            AddPattern(&bus, std::move(reversed_stops));
+        }
+    }
+
+    const size_t stop_count = cat_.GetStops().size();
+    stop_pattern_offsets_.assign(stop_count + 1, 0);
+    for(const Pattern& pattern : patterns_) {
+        for(const uint32_t stop : pattern.stops) {
+            ++stop_pattern_offsets_[stop + 1];
+        }
+    }
+    for(size_t stop = 0; stop < stop_count; ++stop) {
+        stop_pattern_offsets_[stop + 1] += stop_pattern_offsets_[stop];
+    }
+    stop_patterns_.resize(stop_pattern_offsets_.back());
+    std::vector<uint32_t> fill(stop_pattern_offsets_.begin(), stop_pattern_offsets_.end() - 1);
+    for(uint32_t pattern = 0; pattern < patterns_.size(); ++pattern) {
+        const std::vector<uint32_t>& stops = patterns_[pattern].stops;
+        for(uint32_t position = 0; position < stops.size(); ++position) {
+            stop_patterns_[fill[stops[position]]++] = {pattern, position};
+        }
+    }
+}
+
+void RaptorRouter::AddPattern(const Bus* bus, std::vector<uint32_t>&& stops) {
+    if(stops.size() < 2) {
+        return;
+    }
+    Pattern& pattern = patterns_.emplace_back(Pattern{bus, std::move(stops), {}});
+    const std::deque<Stop>& all_stops = cat_.GetStops();
+    pattern.distances.reserve(pattern.stops.size());
+    pattern.distances.push_back(0);
+    for(size_t position = 1; position < pattern.stops.size(); ++position) {
+        pattern.distances.push_back(pattern.distances.back() + cat_.GetDistance({
+            &all_stops[pattern.stops[position - 1]],
+            &all_stops[pattern.stops[position]]
+        }));
+    }
+}
+
+double RaptorRouter::GetRideTime(const Pattern& pattern, uint32_t board_position, uint32_t alight_position) const {
+    // расстояние целым числом, как при построении ребер графа - то же время поездки
+    return static_cast<double>(pattern.distances[alight_position] - pattern.distances[board_position]) / bus_velocity_;
+}
+
+std::vector<RaptorJourney> RaptorRouter::FindJourneys(const Stop* from, const Stop* to, size_t max_transfers) const {
+    if(from == to) {
+        return {RaptorJourney{}};
+    }
+    const size_t stop_count = cat_.GetStops().size();
+    const uint32_t source = static_cast<uint32_t>(from->id);
+    const uint32_t target = static_cast<uint32_t>(to->id);
+    constexpr double UNREACHED = std::numeric_limits<double>::infinity();
+    constexpr uint32_t NO_POSITION = std::numeric_limits<uint32_t>::max();
+
+    // times[k][stop] - лучшее время не более чем на k автобусах
+    std::vector<std::vector<double>> times(1, std::vector<double>(stop_count, UNREACHED));
+    std::vector<std::vector<Label>> labels(1, std::vector<Label>(stop_count));
+    // лучшее время по всем раундам - отсекает поездки, которые ничего не улучшают
+    std::vector<double> best_times(stop_count, UNREACHED);
+    times[0][source] = 0.0;
+    best_times[source] = 0.0;
+
+    std::vector<uint32_t> marked_stops{source};
+    std::vector<bool> is_marked(stop_count, false);
+    is_marked[source] = true;
+    // для маршрута - первая позиция, с которой его нужно просмотреть в раунде
+    std::vector<uint32_t> pattern_starts(patterns_.size(), NO_POSITION);
+    std::vector<uint32_t> marked_patterns;
+
+    std::vector<RaptorJourney> result;
+    for(size_t round = 1; !marked_stops.empty() && round - 1 <= max_transfers; ++round) {
+        for(const uint32_t stop : marked_stops) {
+            is_marked[stop] = false;
+            for(uint32_t i = stop_pattern_offsets_[stop]; i < stop_pattern_offsets_[stop + 1]; ++i) {
+                const StopPattern& stop_pattern = stop_patterns_[i];
+                if(pattern_starts[stop_pattern.pattern] == NO_POSITION) {
+                    marked_patterns.push_back(stop_pattern.pattern);
+                }
+                pattern_starts[stop_pattern.pattern] = std::min(pattern_starts[stop_pattern.pattern], stop_pattern.position);
+            }
+        }
+        marked_stops.clear();
+
+        times.push_back(times.back());
+        labels.push_back(labels.back());
+        const std::vector<double>& previous_times = times[round - 1];
+        std::vector<double>& round_times = times[round];
+        std::vector<Label>& round_labels = labels[round];
+
+        for(const uint32_t pattern_id : marked_patterns) {
+            const Pattern& pattern = patterns_[pattern_id];
+            uint32_t board_position = NO_POSITION;
+            for(uint32_t position = pattern_starts[pattern_id]; position < pattern.stops.size(); ++position) {
+                const uint32_t stop = pattern.stops[position];
+                if(board_position != NO_POSITION) {
+                    const double arrival = previous_times[pattern.stops[board_position]] + bus_wait_time_
+                        + GetRideTime(pattern, board_position, position);
+                    if(arrival < best_times[stop] && arrival < best_times[target]) {
+                        round_times[stop] = arrival;
+                        best_times[stop] = arrival;
+                        round_labels[stop] = {pattern_id, board_position, position};
+                        if(!is_marked[stop]) {
+                            is_marked[stop] = true;
+                            marked_stops.push_back(stop);
+                        }
+                    }
+                }
+                // сесть здесь выгоднее, чем ехать с прежней остановки посадки
+                if(previous_times[stop] != UNREACHED
+                   && (board_position == NO_POSITION
+                       || previous_times[stop] < previous_times[pattern.stops[board_position]]
+                                                 + GetRideTime(pattern, board_position, position))) {
+                    board_position = position;
+                }
+            }
+            pattern_starts[pattern_id] = NO_POSITION;
+        }
+        marked_patterns.clear();
+
+        if(round_times[target] < previous_times[target]) {
+            result.push_back(RestoreJourney(labels, round, target, round_times[target]));
+        }
+    }
+    return result;
+}
+
+RaptorJourney RaptorRouter::RestoreJourney(const std::vector<std::vector<Label>>& labels, size_t round,
+                                           uint32_t stop_to, double total_time) const {
+    RaptorJourney journey;
+    journey.total_time = total_time;
+    // с конца: участок раунда k начинается на остановке, время до которой найдено в раунде k - 1
+    for(uint32_t stop = stop_to; labels[round][stop].pattern != NO_PATTERN; --round) {
+        const Label& label = labels[round][stop];
+        const Pattern& pattern = patterns_[label.pattern];
+        stop = pattern.stops[label.board_position];
+        journey.legs.push_back({
+            &cat_.GetStops()[stop],
+            pattern.bus,
+            static_cast<int>(label.alight_position - label.board_position),
+            GetRideTime(pattern, label.board_position, label.alight_position)
+        });
+    }
+    std::reverse(journey.legs.begin(), journey.legs.end());
+    journey.transfers = journey.legs.empty() ? 0 : journey.legs.size() - 1;
+    return journey;
+}
+
+} // namespace catalogue
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace catalogue {
+
+// участок поездки: ожидание на остановке from и проезд span остановок на автобусе bus
+struct RaptorLeg {
+    const Stop* from = nullptr;
+    const Bus* bus = nullptr;
+    int span = 0;
+    // время в автобусе без ожидания
+    double ride_time = 0.0;
+};
+
+struct RaptorJourney {
+    double total_time = 0.0;
+    // пересадки - поездки на автобусе после первой
+    size_t transfers = 0;
+    std::vector<RaptorLeg> legs;
+};
+
+// Поиск маршрутов по раундам (RAPTOR) прямо по остановкам автобусов справочника,
+// без графа с ребрами между всеми парами остановок маршрута.
+// Раунд k находит самые быстрые поездки не более чем на k автобусах: просматриваются
+// только маршруты через остановки, улучшенные в раунде k - 1, каждый - один раз
+// подряд по остановкам. Критериев два - время и число пересадок: раунды, в которых
+// улучшилось время до остановки назначения, образуют Парето-фронт.
+class RaptorRouter {
+public:
+    static constexpr size_t UNLIMITED_TRANSFERS = std::numeric_limits<size_t>::max();
+
+    RaptorRouter(const TransportCatalogue& cat, const RoutingSettings& settings);
+
+    // Парето-оптимальные поездки по возрастанию числа пересадок (и убыванию времени):
+    // каждая быстрее всех поездок с меньшим числом пересадок. Последняя - самая быстрая
+    // среди поездок не более чем с max_transfers пересадками. Пусто - маршрута нет.
+    std::vector<RaptorJourney> FindJourneys(const Stop* from, const Stop* to,
+                                            size_t max_transfers = UNLIMITED_TRANSFERS) const;
+
+private:
+    // направление движения автобуса: остановки подряд и расстояния от первой
+    struct Pattern {
+        const Bus* bus;
+        std::vector<uint32_t> stops;
+        std::vector<uint64_t> distances;
+    };
+    // маршрут, проходящий через остановку, и номер остановки в нем
+    struct StopPattern {
+        uint32_t pattern;
+        uint32_t position;
+    };
+    // как получено время до остановки в раунде
+    struct Label {
+        // NO_PATTERN - остановка отправления (или время не найдено)
+        uint32_t pattern = NO_PATTERN;
+        uint32_t board_position = 0;
+        uint32_t alight_position = 0;
+    };
+
+    void AddPattern(const Bus* bus, std::vector<uint32_t>&& stops);
+    double GetRideTime(const Pattern& pattern, uint32_t board_position, uint32_t alight_position) const;
+    RaptorJourney RestoreJourney(const std::vector<std::vector<Label>>& labels, size_t round,
+                                 uint32_t stop_to, double total_time) const;
+
+    static constexpr uint32_t NO_PATTERN = std::numeric_limits<uint32_t>::max();
+
+    const TransportCatalogue& cat_;
+    const double bus_wait_time_;
+    const double bus_velocity_;
+
+    std::vector<Pattern> patterns_;
+    // маршруты через остановку (CSR), индекс - Stop::id
+    std::vector<uint32_t> stop_pattern_offsets_;
+    std::vector<StopPattern> stop_patterns_;
+};
+
+} // namespace catalogue
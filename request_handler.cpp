@@ -1,5 +1,7 @@
 #include "request_handler.h"
 
+#include <algorithm>
+
 std::optional<BusStat> RequestHandler::GetBusStat(const std::string_view& bus_name) const {
     BusStat stat = db_.GetBusInfo(bus_name);
     if(!stat.IsExsists) {
@@ -18,46 +20,261 @@ std::optional<StopInfo> RequestHandler::GetStopInfo(const std::string_view& stop
     }
 }
 
-RequestHandler::RequestHandler(const TransportCatalogue& db, renderer::MapRenderer& renderer, graph::Router<BusRouteWeight>& router, catalogue::TransportRouter& t_router)
-    : db_(db), renderer_(renderer), router_(router), t_router_(t_router)
+RequestHandler::RequestHandler(const TransportCatalogue& db,
+    std::function<renderer::MapRenderer&()> renderer_loader,
+    std::function<RoutingContext()> routing_loader)
+    : db_(db)
+    , renderer_loader_(std::move(renderer_loader))
+    , routing_loader_(std::move(routing_loader))
 {
 }
 
+RequestHandler::Routing::Routing(RoutingContext context)
+    : t_router(context.t_router), routing_indexes(context.routing_indexes)
+{
+    const catalogue::RoutingSettings& settings = t_router.GetRoutingSettings();
+    if(settings.router_type != catalogue::RouterType::ALL_PAIRS) {
+        dijkstra_router = std::make_unique<graph::DijkstraRouter<BusRouteWeight>>(
+            t_router.GetRouteGraph<BusRouteWeight>(),
+            settings.router_cache_size
+        );
+    }
+    if(settings.router_type == catalogue::RouterType::A_STAR) {
+        astar_router = std::make_unique<graph::AStarRouter<BusRouteWeight>>(
+            t_router.GetRouteGraph<BusRouteWeight>(),
+            t_router.GetTravelTimeLowerBound()
+        );
+    }
 
+    // настройка иерархии под веса - при загрузке, без пересчета порядка и ярлыков
+    if(const auto* cch = routing_indexes.customizable_contraction_hierarchy) {
+        if(settings.router_type == catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES) {
+            const graph::DirectedWeightedGraph<BusRouteWeight>& graph = t_router.GetRouteGraph<BusRouteWeight>();
+            std::vector<BusRouteWeight> edge_weights;
+            edge_weights.reserve(graph.GetEdgeCount());
+            for(graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+                edge_weights.push_back(graph.GetEdge(edge_id).weight);
+            }
+            cch_metric = cch->Customize(edge_weights);
+        }
+    }
+}
+
+const RequestHandler::Routing& RequestHandler::GetRouting() const {
+    if(!routing_) {
+        routing_ = std::make_unique<Routing>(routing_loader_());
+    }
+    return *routing_;
+}
 
 std::string RequestHandler::RenderMap() {
+    if(!renderer_) {
+        renderer_ = &renderer_loader_();
+    }
     std::deque<const Bus*> buses = db_.GetBusesSorted();
-    renderer_.RenderRoutes(buses);
+    renderer_->RenderRoutes(buses);
 
     const auto stops_to_buses = db_.GetStopsToBuses();
     const auto stopname_to_stops = db_.GetStopnameToStops();
-    renderer_.RenderStops(stopname_to_stops, stops_to_buses);
+    renderer_->RenderStops(stopname_to_stops, stops_to_buses);
 
     std::ostringstream out;
-    renderer_.Render({out, 0, 0});
+    renderer_->Render({out, 0, 0});
 
     return out.str();
 }
 
 std::optional<graph::Router<BusRouteWeight>::RouteInfo> RequestHandler::GetRouteInfo(std::string_view stop_from, std::string_view stop_to) const {
+    const Routing& routing = GetRouting();
+    const graph::VertexId from = routing.t_router.GetStopVertexIndex(stop_from);
+    const graph::VertexId to = routing.t_router.GetStopVertexIndex(stop_to);
+
     // информация о маршруте в представлении graph::router
-    std::optional<graph::Router<BusRouteWeight>::RouteInfo> route_info = router_.BuildRoute(
-        t_router_.GetStopVertexIndex(stop_from),
-        t_router_.GetStopVertexIndex(stop_to)
-    );
-    return route_info;
+    switch (routing.t_router.GetRoutingSettings().router_type)
+    {
+    case catalogue::RouterType::ALL_PAIRS:
+        return BuildAllPairsRoute(from, to);
+    case catalogue::RouterType::DIJKSTRA:
+        return routing.dijkstra_router->BuildRoute(from, to);
+    case catalogue::RouterType::CONTRACTION_HIERARCHIES:
+        if(!routing.routing_indexes.contraction_hierarchy) {
+            throw std::logic_error("Contraction hierarchy is not loaded");
+        }
+        return routing.routing_indexes.contraction_hierarchy->BuildRoute(from, to);
+    case catalogue::RouterType::A_STAR:
+        return routing.astar_router->BuildRoute(from, to);
+    case catalogue::RouterType::HUB_LABELS:
+        if(!routing.routing_indexes.hub_labels) {
+            throw std::logic_error("Hub labels are not loaded");
+        }
+        return routing.routing_indexes.hub_labels->BuildRoute(from, to);
+    case catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES:
+        if(!routing.cch_metric) {
+            throw std::logic_error("Customizable contraction hierarchy is not loaded");
+        }
+        return routing.routing_indexes.customizable_contraction_hierarchy->BuildRoute(*routing.cch_metric, from, to);
+    default:
+        throw std::logic_error("Unknown router type");
+    }
+}
+
+std::optional<graph::Router<BusRouteWeight>::RouteInfo> RequestHandler::GetProfileRouteInfo(std::string_view stop_from,
+    std::string_view stop_to, const std::string& profile) const {
+    const Routing& routing = GetRouting();
+    const catalogue::RoutingProfile& routing_profile = GetRoutingProfile(profile);
+    const auto* cch = routing.routing_indexes.customizable_contraction_hierarchy;
+    if(!cch) {
+        throw std::logic_error("Customizable contraction hierarchy is not loaded");
+    }
+    auto metric = routing.cch_profile_metrics.find(profile);
+    if(metric == routing.cch_profile_metrics.end()) {
+        // настройка под веса профиля - один раз на профиль
+        metric = routing.cch_profile_metrics.emplace(profile, cch->Customize(routing.t_router.GetEdgeWeights(routing_profile))).first;
+    }
+    return cch->BuildRoute(metric->second,
+        routing.t_router.GetStopVertexIndex(stop_from), routing.t_router.GetStopVertexIndex(stop_to));
 }
 
+const catalogue::RoutingProfile& RequestHandler::GetRoutingProfile(const std::string& profile) const {
+    const Routing& routing = GetRouting();
+    const auto& profiles = routing.t_router.GetRoutingSettings().profiles;
+    const auto it = profiles.find(profile);
+    if(it == profiles.end()) {
+        throw std::logic_error("Unknown routing profile");
+    }
+    return it->second;
+}
+
+std::optional<graph::Router<BusRouteWeight>::RouteInfo> RequestHandler::BuildAllPairsRoute(graph::VertexId from, graph::VertexId to) const {
+    const Routing& routing = GetRouting();
+    // матрица загружена в память либо отображена из файла
+    if(routing.routing_indexes.router) {
+        return routing.routing_indexes.router->BuildRoute(from, to);
+    }
+    if(routing.routing_indexes.mapped_router) {
+        return routing.routing_indexes.mapped_router->BuildRoute(from, to);
+    }
+    throw std::logic_error("All-pairs router is not loaded");
+}
+
+std::vector<std::optional<graph::Router<BusRouteWeight>::RouteInfo>> RequestHandler::GetRoutesFromStop(
+    std::string_view stop_from, const std::vector<std::string_view>& stops_to) const {
+
+    const Routing& routing = GetRouting();
+    const graph::VertexId from = routing.t_router.GetStopVertexIndex(stop_from);
+    std::vector<std::optional<graph::Router<BusRouteWeight>::RouteInfo>> result;
+    result.reserve(stops_to.size());
+
+    if(routing.t_router.GetRoutingSettings().router_type == catalogue::RouterType::ALL_PAIRS) {
+        // строка матрицы уже рассчитана при создании базы
+        for(std::string_view stop_to : stops_to) {
+            result.push_back(BuildAllPairsRoute(from, routing.t_router.GetStopVertexIndex(stop_to)));
+        }
+    } else {
+        // одно дерево кратчайших путей на все остановки назначения
+        const auto tree = routing.dijkstra_router->GetShortestPathTree(from);
+        for(std::string_view stop_to : stops_to) {
+            result.push_back(routing.dijkstra_router->BuildRoute(*tree, routing.t_router.GetStopVertexIndex(stop_to)));
+        }
+    }
+    return result;
+}
+
+std::vector<catalogue::RaptorJourney> RequestHandler::GetJourneys(std::string_view stop_from, std::string_view stop_to,
+    size_t max_transfers) const {
+    const Routing& routing = GetRouting();
+    const Stop* from = db_.FindStop(stop_from);
+    const Stop* to = db_.FindStop(stop_to);
+    if(!from || !to) {
+        return {};
+    }
+    if(!routing.raptor_router) {
+        routing.raptor_router = std::make_unique<catalogue::RaptorRouter>(db_, routing.t_router.GetRoutingSettings());
+    }
+    return routing.raptor_router->FindJourneys(from, to, max_transfers);
+}
+
+std::optional<catalogue::TimetableJourney> RequestHandler::GetTimetableJourney(std::string_view stop_from,
+    std::string_view stop_to, double departure_time) const {
+    const Routing& routing = GetRouting();
+    const Stop* from = db_.FindStop(stop_from);
+    const Stop* to = db_.FindStop(stop_to);
+    if(!from || !to || !routing.routing_indexes.connection_scan) {
+        return std::nullopt;
+    }
+    return routing.routing_indexes.connection_scan->FindJourney(from, to, departure_time);
+}
+
+std::vector<std::pair<const Stop*, double>> RequestHandler::GetReachableStops(std::string_view stop_from,
+    double max_time) const {
+
+    const Routing& routing = GetRouting();
+    const graph::VertexId from = routing.t_router.GetStopVertexIndex(stop_from);
+    std::vector<std::pair<const Stop*, double>> result;
+    if(routing.t_router.GetRoutingSettings().router_type == catalogue::RouterType::ALL_PAIRS) {
+        if(routing.routing_indexes.router) {
+            result = ScanAllPairsRow(routing.routing_indexes.router->GetRoutesInternalData(), from, max_time);
+        } else if(routing.routing_indexes.mapped_router) {
+            result = ScanAllPairsRow(routing.routing_indexes.mapped_router->GetRoutesInternalData(), from, max_time);
+        } else {
+            throw std::logic_error("All-pairs router is not loaded");
+        }
+    } else {
+        BusRouteWeight max_weight;
+        max_weight.time = max_time;
+        for(const auto& [vertex, weight] : routing.dijkstra_router->GetReachableVertices(from, max_weight)) {
+            if(routing.t_router.IsStopVertex(vertex)) {
+                result.emplace_back(routing.t_router.GetStopByVertexIndex(vertex), weight.time);
+            }
+        }
+    }
+    // при равном времени - по названию, чтобы ответ не зависел от алгоритма
+    std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second != rhs.second ? lhs.second < rhs.second : lhs.first->name_ < rhs.first->name_;
+    });
+    return result;
+}
+
+template <typename RoutesMatrix>
+std::vector<std::pair<const Stop*, double>> RequestHandler::ScanAllPairsRow(const RoutesMatrix& matrix,
+    graph::VertexId from, double max_time) const {
+
+    const Routing& routing = GetRouting();
+    std::vector<std::pair<const Stop*, double>> result;
+    for(graph::VertexId to = 0; to < matrix.GetVertexCount(); ++to) {
+        // вершины других компонент отсекаются без обращения к матрице
+        if(!routing.t_router.IsStopVertex(to) || !matrix.IsReachable(from, to)) {
+            continue;
+        }
+        const double time = matrix.GetWeight(from, to).time;
+        if(time <= max_time) {
+            result.emplace_back(routing.t_router.GetStopByVertexIndex(to), time);
+        }
+    }
+    return result;
+}
 
 // эти методы переделать на транспорт рутер
 const graph::Edge<BusRouteWeight>& RequestHandler::GetEdgeByIndex(graph::EdgeId edge_id) const {
-    return t_router_.GetEdgeByIndex(edge_id);
+    return GetRouting().t_router.GetEdgeByIndex(edge_id);
 }
 
 const Bus* RequestHandler::GetBusByEdgeIndex(graph::EdgeId edge_id) const {
-    return t_router_.GetBusByEdgeIndex(edge_id);
+    return GetRouting().t_router.GetBusByEdgeIndex(edge_id);
 }
 
 const Stop* RequestHandler::GetStopByVertexIndex(graph::VertexId vertex_id) const {
-    return t_router_.GetStopByVertexIndex(vertex_id);
+    return GetRouting().t_router.GetStopByVertexIndex(vertex_id);
+}
+
+const catalogue::RoutingSettings& RequestHandler::GetRoutingSettings() const {
+    return GetRouting().t_router.GetRoutingSettings();
+}
+
+double RequestHandler::GetBusRideTime(graph::EdgeId edge_id) const {
+    return GetRouting().t_router.GetBusRideTime(edge_id);
+}
+
+double RequestHandler::GetBusRideTime(graph::EdgeId edge_id, const catalogue::RoutingProfile& profile) const {
+    return GetRouting().t_router.GetBusRideTime(edge_id, profile);
 }
@@ -3,8 +3,17 @@
 #include "transport_router.h"
 #include "map_renderer.h"
 #include "svg.h"
+#include "dijkstra_router.h"
+#include "astar_router.h"
+#include "raptor_router.h"
 
+#include <functional>
+#include <map>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 // Класс RequestHandler играет роль Фасада, упрощающего взаимодействие JSON reader-а
 // с другими подсистемами приложения.
@@ -14,13 +23,20 @@ using catalogue::BusStat;
 using catalogue::StopInfo;
 using BusPtr = Bus*;
 
+// структуры поиска маршрута, загруженные из базы
+struct RoutingContext {
+    const catalogue::TransportRouter& t_router;
+    catalogue::RoutingIndexes routing_indexes;
+};
+
 class RequestHandler {
 public:
 
-    RequestHandler(const TransportCatalogue& db, 
-    renderer::MapRenderer& renderer, 
-    graph::Router<BusRouteWeight>& router,
-    catalogue::TransportRouter& t_router);
+    // Визуализатор и структуры поиска маршрута загружаются при первом запросе, которому
+    // они нужны: запросы Bus и Stop отвечаются по одному справочнику
+    RequestHandler(const TransportCatalogue& db,
+    std::function<renderer::MapRenderer&()> renderer_loader,
+    std::function<RoutingContext()> routing_loader);
 
     // Возвращает информацию о маршруте (запрос Bus)
     std::optional<BusStat> GetBusStat(const std::string_view& bus_name) const;
@@ -29,20 +45,77 @@ public:
 
     std::optional<StopInfo> GetStopInfo(const std::string_view& bus_name) const;
 
+    // алгоритм поиска выбирается по RoutingSettings::router_type
     std::optional<graph::Router<BusRouteWeight>::RouteInfo> GetRouteInfo(std::string_view stop_from, std::string_view stop_to) const;
 
+    // маршрут при весах профиля RoutingSettings::profiles (настраиваемая иерархия сжатия)
+    std::optional<graph::Router<BusRouteWeight>::RouteInfo> GetProfileRouteInfo(std::string_view stop_from,
+        std::string_view stop_to, const std::string& profile) const;
+    // профиль по имени, неизвестный профиль - исключение
+    const catalogue::RoutingProfile& GetRoutingProfile(const std::string& profile) const;
+
+    // маршруты из одной остановки во все перечисленные: один поиск на остановку отправления,
+    // ответ i соответствует stops_to[i]
+    std::vector<std::optional<graph::Router<BusRouteWeight>::RouteInfo>> GetRoutesFromStop(
+        std::string_view stop_from, const std::vector<std::string_view>& stops_to) const;
+    // Поездки по раундам (RAPTOR) с ограничением числа пересадок - Парето-фронт
+    // (время, пересадки); см. catalogue::RaptorRouter::FindJourneys
+    std::vector<catalogue::RaptorJourney> GetJourneys(std::string_view stop_from, std::string_view stop_to,
+        size_t max_transfers = catalogue::RaptorRouter::UNLIMITED_TRANSFERS) const;
+    // Поездка по расписанию с отправлением не раньше departure_time (Connection Scan);
+    // nullopt - поездки нет или в базе нет рейсов по расписанию
+    std::optional<catalogue::TimetableJourney> GetTimetableJourney(std::string_view stop_from, std::string_view stop_to,
+        double departure_time) const;
+    // остановки, до которых можно доехать из stop_from не дольше чем за max_time, и время
+    // до них (сама stop_from - с нулевым временем), по возрастанию времени.
+    // ALL_PAIRS - просмотр строки матрицы, иначе - один ограниченный поиск Дейкстры
+    std::vector<std::pair<const Stop*, double>> GetReachableStops(std::string_view stop_from, double max_time) const;
+
 
     const graph::Edge<BusRouteWeight>& GetEdgeByIndex(graph::EdgeId edge_id) const;
     const Bus* GetBusByEdgeIndex(graph::EdgeId edge_id) const;
     const Stop* GetStopByVertexIndex(graph::VertexId vertex_id) const;
+    const catalogue::RoutingSettings& GetRoutingSettings() const;
+    double GetBusRideTime(graph::EdgeId edge_id) const;
+    double GetBusRideTime(graph::EdgeId edge_id, const catalogue::RoutingProfile& profile) const;
 
 private:
+    // структуры поиска маршрута и построенные по ним при загрузке
+    struct Routing {
+        explicit Routing(RoutingContext context);
+
+        const catalogue::TransportRouter& t_router;
+        const catalogue::RoutingIndexes routing_indexes;
+        // для RouterType::DIJKSTRA - основной алгоритм, для остальных (кроме ALL_PAIRS) -
+        // поиск из одной остановки во многие
+        std::unique_ptr<graph::DijkstraRouter<BusRouteWeight>> dijkstra_router;
+        std::unique_ptr<graph::AStarRouter<BusRouteWeight>> astar_router;
+        // работает по справочнику, а не по графу - доступен при любом RouterType;
+        // строится при первом запросе с max_transfers или pareto
+        mutable std::unique_ptr<catalogue::RaptorRouter> raptor_router;
+        // веса иерархии при основных настройках (для CUSTOMIZABLE_CONTRACTION_HIERARCHIES) -
+        // настраиваются при загрузке, для профиля - при первом запросе с ним
+        using CchMetric = graph::CustomizableContractionHierarchy<BusRouteWeight>::Metric;
+        std::optional<CchMetric> cch_metric;
+        mutable std::map<std::string, CchMetric, std::less<>> cch_profile_metrics;
+    };
+
+    // загружает структуры при первом вызове
+    const Routing& GetRouting() const;
+
+    std::optional<graph::Router<BusRouteWeight>::RouteInfo> BuildAllPairsRoute(graph::VertexId from, graph::VertexId to) const;
+    // строка from матрицы маршрутов: остановки с временем не больше max_time
+    template <typename RoutesMatrix>
+    std::vector<std::pair<const Stop*, double>> ScanAllPairsRow(const RoutesMatrix& matrix,
+        graph::VertexId from, double max_time) const;
+
     // RequestHandler использует агрегацию объектов "Транспортный Справочник" и "Визуализатор Карты"
     const TransportCatalogue& db_;
-    renderer::MapRenderer& renderer_;
+    std::function<renderer::MapRenderer&()> renderer_loader_;
+    renderer::MapRenderer* renderer_ = nullptr;
 
-    const graph::Router<BusRouteWeight>& router_;
-    const catalogue::TransportRouter& t_router_;
+    std::function<RoutingContext()> routing_loader_;
+    mutable std::unique_ptr<Routing> routing_;
 };
 
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "graph.h"
+#include "routes_matrix.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
@@ -18,17 +20,18 @@ template <typename Weight>
 class Router {
 private:
     using Graph = DirectedWeightedGraph<Weight>;
+    using Block = RoutesMatrix<Weight>;
     
 public:
 
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
-    };
+    using RouteInternalData = graph::RouteInternalData<Weight>;
+    // Матрица хранится блоками по компонентам связности графа (без учета направления
+    // ребер): между компонентами путей нет, и память пропорциональна сумме квадратов
+    // размеров компонент, а не квадрату числа вершин.
+    using RoutesInternalData = ComponentRoutesMatrix<Weight>;
 
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
-
-    explicit Router(const Graph& graph);
+    // thread_count > 1 - параллельный расчет блоками строк
+    explicit Router(const Graph& graph, size_t thread_count = 1);
     explicit Router(const Graph& graph, RoutesInternalData&& routes_internal_data);
 
     struct RouteInfo {
@@ -39,80 +42,270 @@ public:
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
     const typename Router<Weight>::RoutesInternalData& GetRoutesInternalData() const;
+
+    // Дополняет матрицу после добавления в граф вершин и ребер с EdgeId >= first_new_edge.
+    // Компоненты, соединенные новыми ребрами, объединяются. Новые ребра только укорачивают
+    // пути, поэтому достаточно релаксации через каждое новое ребро; пересчитываются
+    // только строки, в которых ребро что-то улучшает.
+    void AddEdges(EdgeId first_new_edge);
+    // перенумерация ребер после заморозки графа: new_to_old[new_edge_id] = old_edge_id
+    void RenumberEdges(const std::vector<EdgeId>& new_to_old);
     
 
 private:
 
+    // Компоненты связности: вершины компонент - по возрастанию,
+    // компоненты - по возрастанию наименьшей вершины
+    static std::vector<std::vector<VertexId>> ComputeComponents(const Graph& graph) {
+        std::vector<VertexId> parents(graph.GetVertexCount());
+        for (VertexId vertex = 0; vertex < parents.size(); ++vertex) {
+            parents[vertex] = vertex;
+        }
+        auto find_root = [&parents](VertexId vertex) {
+            while (parents[vertex] != vertex) {
+                parents[vertex] = parents[parents[vertex]];
+                vertex = parents[vertex];
+            }
+            return vertex;
+        };
+        for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph.GetEdge(edge_id);
+            const VertexId root_from = find_root(edge.from);
+            const VertexId root_to = find_root(edge.to);
+            // корень - наименьшая вершина компоненты
+            parents[std::max(root_from, root_to)] = std::min(root_from, root_to);
+        }
+
+        std::vector<std::vector<VertexId>> components;
+        std::vector<size_t> root_components(parents.size());
+        for (VertexId vertex = 0; vertex < parents.size(); ++vertex) {
+            const VertexId root = find_root(vertex);
+            if (root == vertex) {
+                root_components[vertex] = components.size();
+                components.emplace_back();
+            }
+            components[root_components[root]].push_back(vertex);
+        }
+        return components;
+    }
+
     void InitializeRoutesInternalData(const Graph& graph) {
+        if (graph.GetEdgeCount() > Block::MAX_EDGE_ID + 1) {
+            throw std::length_error("Too many edges for routes matrix");
+        }
         const size_t vertex_count = graph.GetVertexCount();
         for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
+            Block& block = routes_internal_data_.GetBlock(routes_internal_data_.GetComponent(vertex));
+            const VertexId local_from = routes_internal_data_.GetLocalVertex(vertex);
+            block.Set(local_from, local_from, RouteInternalData{ZERO_WEIGHT, std::nullopt});
             for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                 const auto& edge = graph.GetEdge(edge_id);
                 if (edge.weight < ZERO_WEIGHT) {
                     throw std::domain_error("Edges' weights should be non-negative");
                 }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                    route_internal_data = RouteInternalData{edge.weight, edge_id};
+                const VertexId local_to = routes_internal_data_.GetLocalVertex(edge.to);
+                if (!block.IsReachable(local_from, local_to)
+                    || block.GetWeight(local_from, local_to) > edge.weight) {
+                    block.Set(local_from, local_to, RouteInternalData{edge.weight, edge_id});
                 }
             }
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
+    // Ячейки строк идут подряд, поэтому проход по vertex_to - последовательное
+    // чтение столбцов матрицы. Сам проход - RouteWeightColumns::RelaxRow:
+    // для отдельных весов он может быть векторизован.
+    // Здесь и далее номера вершин - локальные номера в блоке компоненты.
+    static void RelaxRowThroughVertex(Block& block, VertexId vertex_from, VertexId vertex_through,
+                                      VertexId column_begin, VertexId column_end) {
+        if (!block.IsReachable(vertex_from, vertex_through)) {
+            return;
+        }
+        const uint32_t prev_edge_from = block.GetPrevEdges()[block.GetIndex(vertex_from, vertex_through)];
+        block.GetWeightColumns().RelaxRow(
+            block.GetPrevEdges(),
+            block.GetIndex(vertex_from, 0),
+            block.GetIndex(vertex_through, 0),
+            block.GetWeight(vertex_from, vertex_through),
+            prev_edge_from,
+            column_begin, column_end);
+    }
+
+    static void ComputeBlock(Block& block) {
+        const size_t vertex_count = block.GetVertexCount();
+        for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
+            for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
+                RelaxRowThroughVertex(block, vertex_from, vertex_through, 0, vertex_count);
+            }
+        }
+    }
+
+    // На шаге с фиксированной вершиной vertex_through строка и столбец этой вершины
+    // не меняются, а остальные ячейки независимы. Поэтому блоки строк можно
+    // обрабатывать параллельно с тем же результатом, что и последовательный обход.
+    // Столбцы разбиты на полосы, чтобы полоса строки vertex_through оставалась в кеше,
+    // пока по ней проходят все строки блока.
+    static void RelaxRowBlockThroughVertex(Block& block, VertexId vertex_through,
+                                           VertexId row_begin, VertexId row_end) {
+        const size_t vertex_count = block.GetVertexCount();
+        for (VertexId column_begin = 0; column_begin < vertex_count; column_begin += COLUMN_TILE_SIZE) {
+            const VertexId column_end = std::min(vertex_count, column_begin + COLUMN_TILE_SIZE);
+            for (VertexId vertex_from = row_begin; vertex_from < row_end; ++vertex_from) {
+                RelaxRowThroughVertex(block, vertex_from, vertex_through, column_begin, column_end);
+            }
+        }
+    }
+
+    static void ComputeBlockParallel(Block& block, parallel::ThreadPool& pool, size_t thread_count) {
+        const size_t vertex_count = block.GetVertexCount();
+        // несколько блоков строк на поток для выравнивания нагрузки
+        const size_t block_size = std::max<size_t>(1, vertex_count / (thread_count * BLOCKS_PER_THREAD));
+        const size_t block_count = (vertex_count + block_size - 1) / block_size;
+        for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
+            pool.ParallelFor(block_count, [&](size_t row_block) {
+                const VertexId row_begin = row_block * block_size;
+                RelaxRowBlockThroughVertex(block, vertex_through,
+                                           row_begin, std::min(vertex_count, row_begin + block_size));
+            });
+        }
+    }
+
+    // Крупные компоненты считаются по очереди с разбиением на блоки строк,
+    // мелкие - целиком, параллельно друг с другом
+    void ComputeRoutesInternalDataParallel(size_t thread_count) {
+        parallel::ThreadPool pool(thread_count);
+        std::vector<size_t> small_components;
+        for (size_t component = 0; component < routes_internal_data_.GetComponentCount(); ++component) {
+            Block& block = routes_internal_data_.GetBlock(component);
+            if (block.GetVertexCount() >= MIN_ROW_PARALLEL_COMPONENT_SIZE) {
+                ComputeBlockParallel(block, pool, thread_count);
+            } else {
+                small_components.push_back(component);
+            }
         }
+        pool.ParallelFor(small_components.size(), [&](size_t index) {
+            ComputeBlock(routes_internal_data_.GetBlock(small_components[index]));
+        });
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
+    // Пути i -> j через новое ребро u -> v: i -> u, ребро, v -> j.
+    // Если ребро не улучшает путь i -> v, то не улучшит и ни один путь i -> j.
+    // Строка v при этом не меняется (веса неотрицательны), поэтому один проход точен.
+    // Концы ребра к этому моменту - в одной компоненте.
+    void RelaxThroughEdge(EdgeId edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        if (edge.weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        Block& block = routes_internal_data_.GetBlock(routes_internal_data_.GetComponent(edge.from));
+        const VertexId local_from = routes_internal_data_.GetLocalVertex(edge.from);
+        const VertexId local_to = routes_internal_data_.GetLocalVertex(edge.to);
+        const size_t vertex_count = block.GetVertexCount();
+        const uint32_t encoded_edge = Block::EncodePrevEdge(edge_id);
+
         for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-                    }
-                }
+            if (!block.IsReachable(vertex_from, local_from)) {
+                continue;
+            }
+            const Weight weight_from = block.GetWeight(vertex_from, local_from) + edge.weight;
+            if (block.IsReachable(vertex_from, local_to)
+                && !(weight_from < block.GetWeight(vertex_from, local_to))) {
+                continue;
+            }
+            block.GetWeightColumns().RelaxRow(
+                block.GetPrevEdges(),
+                block.GetIndex(vertex_from, 0),
+                block.GetIndex(local_to, 0),
+                weight_from,
+                encoded_edge,
+                0, vertex_count);
+        }
+    }
+
+    // объединяет компоненты, которые соединяют ребра с EdgeId >= first_new_edge
+    void MergeComponentsOfEdges(EdgeId first_new_edge) {
+        const size_t component_count = routes_internal_data_.GetComponentCount();
+        std::vector<size_t> parents(component_count);
+        for (size_t component = 0; component < component_count; ++component) {
+            parents[component] = component;
+        }
+        auto find_root = [&parents](size_t component) {
+            while (parents[component] != component) {
+                parents[component] = parents[parents[component]];
+                component = parents[component];
             }
+            return component;
+        };
+        bool merged = false;
+        for (EdgeId edge_id = first_new_edge; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            const size_t root_from = find_root(routes_internal_data_.GetComponent(edge.from));
+            const size_t root_to = find_root(routes_internal_data_.GetComponent(edge.to));
+            if (root_from != root_to) {
+                parents[std::max(root_from, root_to)] = std::min(root_from, root_to);
+                merged = true;
+            }
+        }
+        if (!merged) {
+            return;
         }
+
+        std::vector<size_t> merged_components(component_count);
+        size_t merged_count = 0;
+        for (size_t component = 0; component < component_count; ++component) {
+            const size_t root = find_root(component);
+            merged_components[component] = root == component ? merged_count++ : merged_components[root];
+        }
+        routes_internal_data_.MergeComponents(merged_components);
     }
 
+    // ячеек строки в полосе столбцов: полоса строки vertex_through помещается в L2
+    static constexpr size_t COLUMN_TILE_SIZE = 4096;
+    static constexpr size_t BLOCKS_PER_THREAD = 4;
+    // компоненты меньше этого размера не делятся на блоки строк
+    static constexpr size_t MIN_ROW_PARALLEL_COMPONENT_SIZE = 256;
     static constexpr Weight ZERO_WEIGHT{};
     const Graph& graph_;
     RoutesInternalData routes_internal_data_;
 };
 
 template <typename Weight>
-Router<Weight>::Router(const Graph& graph)
+Router<Weight>::Router(const Graph& graph, size_t thread_count)
     : graph_(graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+    , routes_internal_data_(graph.GetVertexCount(), ComputeComponents(graph))
 {
     InitializeRoutesInternalData(graph);
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    if (thread_count > 1) {
+        ComputeRoutesInternalDataParallel(thread_count);
+        return;
+    }
+    for (size_t component = 0; component < routes_internal_data_.GetComponentCount(); ++component) {
+        ComputeBlock(routes_internal_data_.GetBlock(component));
     }
 }
 
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+    if (from >= routes_internal_data_.GetVertexCount() || to >= routes_internal_data_.GetVertexCount()) {
+        throw std::out_of_range("Bad VertexId requested");
+    }
+    const size_t component = routes_internal_data_.GetComponent(from);
+    if (component != routes_internal_data_.GetComponent(to)) {
+        return std::nullopt;
+    }
+    const Block& block = routes_internal_data_.GetBlock(component);
+    const VertexId local_from = routes_internal_data_.GetLocalVertex(from);
+    const VertexId local_to = routes_internal_data_.GetLocalVertex(to);
+    if (!block.IsReachable(local_from, local_to)) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+    const Weight weight = block.GetWeight(local_from, local_to);
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
+    for (std::optional<EdgeId> edge_id = block.GetPrevEdge(local_from, local_to);
          edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
+         edge_id = block.GetPrevEdge(local_from, routes_internal_data_.GetLocalVertex(graph_.GetEdge(*edge_id).from)))
     {
         edges.push_back(*edge_id);
     }
@@ -127,10 +320,35 @@ Router<Weight>::GetRoutesInternalData() const {
     return routes_internal_data_;
 }
 
+template <typename Weight>
+void Router<Weight>::AddEdges(EdgeId first_new_edge) {
+    if (graph_.GetEdgeCount() > Block::MAX_EDGE_ID + 1) {
+        throw std::length_error("Too many edges for routes matrix");
+    }
+    const size_t old_vertex_count = routes_internal_data_.GetVertexCount();
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (vertex_count < old_vertex_count) {
+        throw std::logic_error("Graph has fewer vertices than routes matrix");
+    }
+    routes_internal_data_.AddVertices(vertex_count - old_vertex_count);
+    for (VertexId vertex = old_vertex_count; vertex < vertex_count; ++vertex) {
+        routes_internal_data_.Set(vertex, vertex, RouteInternalData{ZERO_WEIGHT, std::nullopt});
+    }
+    MergeComponentsOfEdges(first_new_edge);
+    for (EdgeId edge_id = first_new_edge; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        RelaxThroughEdge(edge_id);
+    }
+}
+
+template <typename Weight>
+void Router<Weight>::RenumberEdges(const std::vector<EdgeId>& new_to_old) {
+    routes_internal_data_.RenumberEdges(new_to_old);
+}
+
 template <typename Weight>
 Router<Weight>::Router(const Graph& graph,
     RoutesInternalData&& routes_internal_data)
     : graph_(graph)
-    , routes_internal_data_(routes_internal_data) {}
+    , routes_internal_data_(std::move(routes_internal_data)) {}
 
 }  // namespace graph
\ No newline at end of file
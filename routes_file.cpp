@@ -0,0 +1,63 @@
+#include "routes_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace graph {
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Can't open file " + path.string());
+    }
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Can't stat file " + path.string());
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if(size_ != 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if(data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Can't map file " + path.string());
+        }
+        // запросы читают отдельные строки - упреждающее чтение соседних страниц бесполезно
+        madvise(data, size_, MADV_RANDOM);
+        data_ = static_cast<const std::byte*>(data);
+    }
+    // отображение остается действительным и после закрытия дескриптора
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    Unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if(this != &other) {
+        Unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void MappedFile::Unmap() {
+    if(data_) {
+        munmap(const_cast<std::byte*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+} // namespace graph
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "graph.h"
+#include "routes_matrix.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Файл матрицы маршрутов с записями фиксированного размера - для баз, матрица
+// которых не помещается в память. Файл отображается в память (mmap), и поиск
+// маршрута читает только нужную строку: рабочим набором страниц управляет ОС.
+//
+// Формат (порядок байт - как у машины, создавшей базу):
+//   RoutesFileHeader
+//   RoutesFileVertex[vertex_count]      - компонента и номер вершины в ее блоке
+//   RoutesFileComponent[component_count] - размер блока и смещение его записей
+//   RouteRecord<Weight>[n * n] для каждой компоненты, строки подряд
+struct RoutesFileHeader {
+    char magic[8];
+    uint32_t version;
+    // sizeof(RouteRecord<Weight>) - защита от чтения файла с другим весом
+    uint32_t record_size;
+    uint64_t vertex_count;
+    uint64_t component_count;
+};
+
+struct RoutesFileVertex {
+    uint32_t component;
+    uint32_t local_vertex;
+};
+
+struct RoutesFileComponent {
+    uint64_t vertex_count;
+    // смещение первой записи блока от начала файла
+    uint64_t records_offset;
+};
+
+template <typename Weight>
+struct RouteRecord {
+    Weight weight;
+    // закодирован как в RoutesMatrix: EdgeId, RoutePrevEdge::NO_EDGE или UNREACHABLE
+    uint32_t prev_edge;
+};
+
+inline constexpr char ROUTES_FILE_MAGIC[8] = {'T', 'C', 'R', 'O', 'U', 'T', 'E', 'S'};
+inline constexpr uint32_t ROUTES_FILE_VERSION = 1;
+// выравнивание начала записей - по строке кеша
+inline constexpr size_t ROUTES_FILE_RECORDS_ALIGNMENT = 64;
+
+// Файл, отображенный в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const std::byte* GetData() const {
+        return data_;
+    }
+    size_t GetSize() const {
+        return size_;
+    }
+
+private:
+    void Unmap();
+
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Записывает матрицу в поток: смещения записей - от начала записанного,
+// поэтому те же данные могут быть и отдельным файлом, и разделом другого файла
+// (начало раздела тогда выровнено по ROUTES_FILE_RECORDS_ALIGNMENT)
+template <typename Weight>
+void WriteRoutesData(std::ostream& out, const ComponentRoutesMatrix<Weight>& matrix) {
+    static_assert(std::is_trivially_copyable_v<Weight>, "Routes file stores weights as raw bytes");
+    using Record = RouteRecord<Weight>;
+
+    RoutesFileHeader header{};
+    std::memcpy(header.magic, ROUTES_FILE_MAGIC, sizeof(header.magic));
+    header.version = ROUTES_FILE_VERSION;
+    header.record_size = sizeof(Record);
+    header.vertex_count = matrix.GetVertexCount();
+    header.component_count = matrix.GetComponentCount();
+
+    std::vector<RoutesFileVertex> vertices(matrix.GetVertexCount());
+    for (VertexId vertex = 0; vertex < vertices.size(); ++vertex) {
+        vertices[vertex] = {static_cast<uint32_t>(matrix.GetComponent(vertex)),
+                            static_cast<uint32_t>(matrix.GetLocalVertex(vertex))};
+    }
+
+    uint64_t offset = sizeof(RoutesFileHeader)
+        + vertices.size() * sizeof(RoutesFileVertex)
+        + matrix.GetComponentCount() * sizeof(RoutesFileComponent);
+    const uint64_t padding = (ROUTES_FILE_RECORDS_ALIGNMENT - offset % ROUTES_FILE_RECORDS_ALIGNMENT)
+        % ROUTES_FILE_RECORDS_ALIGNMENT;
+    offset += padding;
+    std::vector<RoutesFileComponent> components(matrix.GetComponentCount());
+    for (size_t component = 0; component < components.size(); ++component) {
+        const uint64_t vertex_count = matrix.GetBlock(component).GetVertexCount();
+        components[component] = {vertex_count, offset};
+        offset += vertex_count * vertex_count * sizeof(Record);
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(RoutesFileVertex));
+    out.write(reinterpret_cast<const char*>(components.data()), components.size() * sizeof(RoutesFileComponent));
+    const std::vector<char> zeros(padding, 0);
+    out.write(zeros.data(), zeros.size());
+
+    // запись по строке: в памяти нужна только одна строка записей
+    std::vector<Record> row;
+    for (size_t component = 0; component < matrix.GetComponentCount(); ++component) {
+        const RoutesMatrix<Weight>& block = matrix.GetBlock(component);
+        const size_t vertex_count = block.GetVertexCount();
+        row.resize(vertex_count);
+        for (VertexId from = 0; from < vertex_count; ++from) {
+            for (VertexId to = 0; to < vertex_count; ++to) {
+                // обнуляются и байты выравнивания - содержимое файла не зависит от мусора в памяти;
+                // Weight с инициализаторами полей нетривиален, но копируется побайтно
+                std::memset(static_cast<void*>(&row[to]), 0, sizeof(Record));
+                row[to].prev_edge = block.GetPrevEdges()[block.GetIndex(from, to)];
+                if (row[to].prev_edge != RoutePrevEdge::UNREACHABLE) {
+                    row[to].weight = block.GetWeight(from, to);
+                }
+            }
+            out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(Record));
+        }
+    }
+}
+
+// Записывает матрицу в файл. Файл сначала пишется рядом под временным именем
+// и затем переименовывается - процессы, отобразившие прежний файл, его дочитывают.
+template <typename Weight>
+void WriteRoutesFile(const std::filesystem::path& path, const ComponentRoutesMatrix<Weight>& matrix) {
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Can't create routes file " + temp_path.string());
+        }
+        WriteRoutesData(out, matrix);
+        if (!out) {
+            throw std::runtime_error("Can't write routes file " + temp_path.string());
+        }
+    }
+    std::filesystem::rename(temp_path, path);
+}
+
+// Матрица маршрутов из отображенного в память файла, только для чтения.
+// Интерфейс чтения - как у ComponentRoutesMatrix.
+template <typename Weight>
+class MappedRoutesMatrix {
+public:
+    using Record = RouteRecord<Weight>;
+
+    explicit MappedRoutesMatrix(const std::filesystem::path& path)
+        : MappedRoutesMatrix(std::make_shared<const MappedFile>(path)) {
+    }
+    // данные WriteRoutesData с начала отображенного файла
+    explicit MappedRoutesMatrix(std::shared_ptr<const MappedFile> file)
+        : MappedRoutesMatrix(file, 0, file->GetSize()) {
+    }
+    // данные WriteRoutesData в разделе [offset, offset + size) отображенного файла;
+    // отображение живет, пока жива матрица
+    MappedRoutesMatrix(std::shared_ptr<const MappedFile> file, size_t offset, size_t size)
+        : file_(std::move(file))
+        , data_(file_->GetData() + offset)
+        , size_(size) {
+        static_assert(std::is_trivially_copyable_v<Weight>, "Routes file stores weights as raw bytes");
+        if (offset + size > file_->GetSize() || size_ < sizeof(RoutesFileHeader)) {
+            throw std::runtime_error("Bad routes file");
+        }
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, ROUTES_FILE_MAGIC, sizeof(header_.magic)) != 0
+            || header_.version != ROUTES_FILE_VERSION
+            || header_.record_size != sizeof(Record)) {
+            throw std::runtime_error("Bad routes file");
+        }
+        const uint64_t tables_size = sizeof(RoutesFileHeader)
+            + header_.vertex_count * sizeof(RoutesFileVertex)
+            + header_.component_count * sizeof(RoutesFileComponent);
+        if (size_ < tables_size) {
+            throw std::runtime_error("Bad routes file");
+        }
+        vertices_ = reinterpret_cast<const RoutesFileVertex*>(data_ + sizeof(RoutesFileHeader));
+        components_ = reinterpret_cast<const RoutesFileComponent*>(vertices_ + header_.vertex_count);
+        for (size_t component = 0; component < header_.component_count; ++component) {
+            const RoutesFileComponent& entry = components_[component];
+            if (reinterpret_cast<uintptr_t>(data_ + entry.records_offset) % alignof(Record) != 0
+                || entry.records_offset + entry.vertex_count * entry.vertex_count * sizeof(Record) > size_) {
+                throw std::runtime_error("Bad routes file");
+            }
+        }
+        for (VertexId vertex = 0; vertex < header_.vertex_count; ++vertex) {
+            if (vertices_[vertex].component >= header_.component_count
+                || vertices_[vertex].local_vertex >= components_[vertices_[vertex].component].vertex_count) {
+                throw std::runtime_error("Bad routes file");
+            }
+        }
+    }
+
+    size_t GetVertexCount() const {
+        return header_.vertex_count;
+    }
+    size_t GetComponentCount() const {
+        return header_.component_count;
+    }
+    size_t GetComponent(VertexId vertex) const {
+        return vertices_[vertex].component;
+    }
+    VertexId GetLocalVertex(VertexId vertex) const {
+        return vertices_[vertex].local_vertex;
+    }
+
+    bool IsReachable(VertexId from, VertexId to) const {
+        return GetComponent(from) == GetComponent(to)
+            && GetRecord(from, to).prev_edge != RoutePrevEdge::UNREACHABLE;
+    }
+
+    // только для достижимой пары
+    Weight GetWeight(VertexId from, VertexId to) const {
+        return GetRecord(from, to).weight;
+    }
+
+    std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+        if (GetComponent(from) != GetComponent(to)) {
+            return std::nullopt;
+        }
+        const uint32_t prev_edge = GetRecord(from, to).prev_edge;
+        if (prev_edge == RoutePrevEdge::NO_EDGE || prev_edge == RoutePrevEdge::UNREACHABLE) {
+            return std::nullopt;
+        }
+        return prev_edge;
+    }
+
+    // копия в памяти - для дополнения базы (update_base)
+    ComponentRoutesMatrix<Weight> Load() const {
+        std::vector<std::vector<VertexId>> component_vertices(GetComponentCount());
+        for (size_t component = 0; component < component_vertices.size(); ++component) {
+            component_vertices[component].resize(components_[component].vertex_count);
+        }
+        for (VertexId vertex = 0; vertex < GetVertexCount(); ++vertex) {
+            component_vertices[GetComponent(vertex)][GetLocalVertex(vertex)] = vertex;
+        }
+        ComponentRoutesMatrix<Weight> result(GetVertexCount(), std::move(component_vertices));
+        for (size_t component = 0; component < GetComponentCount(); ++component) {
+            RoutesMatrix<Weight>& block = result.GetBlock(component);
+            const Record* records = GetRecords(component);
+            for (VertexId from = 0; from < block.GetVertexCount(); ++from) {
+                for (VertexId to = 0; to < block.GetVertexCount(); ++to) {
+                    const Record& record = records[block.GetIndex(from, to)];
+                    if (record.prev_edge == RoutePrevEdge::UNREACHABLE) {
+                        continue;
+                    }
+                    std::optional<EdgeId> prev_edge;
+                    if (record.prev_edge != RoutePrevEdge::NO_EDGE) {
+                        prev_edge = record.prev_edge;
+                    }
+                    block.Set(from, to, RouteInternalData<Weight>{record.weight, prev_edge});
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    const Record* GetRecords(size_t component) const {
+        return reinterpret_cast<const Record*>(data_ + components_[component].records_offset);
+    }
+
+    // вершины - из одной компоненты
+    const Record& GetRecord(VertexId from, VertexId to) const {
+        const size_t component = GetComponent(from);
+        return GetRecords(component)[GetLocalVertex(from) * components_[component].vertex_count + GetLocalVertex(to)];
+    }
+
+    std::shared_ptr<const MappedFile> file_;
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    RoutesFileHeader header_{};
+    const RoutesFileVertex* vertices_ = nullptr;
+    const RoutesFileComponent* components_ = nullptr;
+};
+
+}  // namespace graph
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace graph {
+
+template <typename Weight>
+struct RouteInternalData {
+    Weight weight;
+    std::optional<EdgeId> prev_edge;
+};
+
+// Закодированный prev_edge ячейки матрицы маршрутов: EdgeId или особое значение
+struct RoutePrevEdge {
+    // маршрут есть, но ребер в нем нет (from == to)
+    static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max() - 1;
+    // маршрута нет
+    static constexpr uint32_t UNREACHABLE = std::numeric_limits<uint32_t>::max();
+};
+
+// Хранение весов матрицы маршрутов по столбцам.
+// По умолчанию вес хранится целиком в одном столбце; для конкретного веса
+// можно объявить специализацию, раскладывающую его на отдельные массивы
+// (и со своей реализацией RelaxRow).
+template <typename Weight>
+struct RouteWeightColumns {
+    std::vector<Weight> weights;
+
+    // новые ячейки считаются недостижимыми
+    void Resize(size_t size) {
+        weights.resize(size);
+    }
+    Weight Get(size_t index) const {
+        return weights[index];
+    }
+    void Set(size_t index, const Weight& weight) {
+        weights[index] = weight;
+    }
+    // значение ячейки, до которой нет маршрута
+    void SetUnreachable(size_t) {
+    }
+
+    // Релаксация строки через промежуточную вершину в столбцах [column_begin, column_end):
+    // ячейка row_from + c заменяется на weight_from + (row_through + c), если так короче.
+    // Предыдущее ребро - из строки row_through, а для ее пустого пути - prev_edge_from.
+    void RelaxRow(std::vector<uint32_t>& prev_edges, size_t row_from, size_t row_through,
+                  const Weight& weight_from, uint32_t prev_edge_from,
+                  size_t column_begin, size_t column_end) {
+        for (size_t column = column_begin; column < column_end; ++column) {
+            const uint32_t prev_edge_to = prev_edges[row_through + column];
+            if (prev_edge_to == RoutePrevEdge::UNREACHABLE) {
+                continue;
+            }
+            const Weight candidate_weight = weight_from + weights[row_through + column];
+            uint32_t& prev_edge_relaxing = prev_edges[row_from + column];
+            if (prev_edge_relaxing == RoutePrevEdge::UNREACHABLE
+                || candidate_weight < weights[row_from + column]) {
+                weights[row_from + column] = candidate_weight;
+                prev_edge_relaxing = prev_edge_to != RoutePrevEdge::NO_EDGE ? prev_edge_to : prev_edge_from;
+            }
+        }
+    }
+};
+
+// Плоская матрица маршрутов V x V, строки подряд (row-major).
+// Структура массивов: веса по столбцам RouteWeightColumns и
+// массив предыдущих ребер с выделенными значениями для особых ячеек.
+template <typename Weight>
+class RoutesMatrix {
+public:
+    static constexpr uint32_t NO_EDGE = RoutePrevEdge::NO_EDGE;
+    static constexpr uint32_t UNREACHABLE = RoutePrevEdge::UNREACHABLE;
+    // наибольший EdgeId, который можно сохранить в матрице
+    static constexpr EdgeId MAX_EDGE_ID = NO_EDGE - 1;
+
+    RoutesMatrix() = default;
+    explicit RoutesMatrix(size_t vertex_count)
+        : vertex_count_(vertex_count)
+        , prev_edges_(vertex_count * vertex_count, UNREACHABLE) {
+        weights_.Resize(vertex_count * vertex_count);
+    }
+
+    size_t GetVertexCount() const {
+        return vertex_count_;
+    }
+
+    size_t GetIndex(VertexId from, VertexId to) const {
+        return from * vertex_count_ + to;
+    }
+
+    bool IsReachable(VertexId from, VertexId to) const {
+        return prev_edges_[GetIndex(from, to)] != UNREACHABLE;
+    }
+
+    Weight GetWeight(VertexId from, VertexId to) const {
+        return weights_.Get(GetIndex(from, to));
+    }
+
+    std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+        const uint32_t prev_edge = prev_edges_[GetIndex(from, to)];
+        if (prev_edge == NO_EDGE || prev_edge == UNREACHABLE) {
+            return std::nullopt;
+        }
+        return prev_edge;
+    }
+
+    std::optional<RouteInternalData<Weight>> Get(VertexId from, VertexId to) const {
+        if (!IsReachable(from, to)) {
+            return std::nullopt;
+        }
+        return RouteInternalData<Weight>{GetWeight(from, to), GetPrevEdge(from, to)};
+    }
+
+    void Set(VertexId from, VertexId to, const RouteInternalData<Weight>& data) {
+        const size_t index = GetIndex(from, to);
+        weights_.Set(index, data.weight);
+        prev_edges_[index] = EncodePrevEdge(data.prev_edge);
+    }
+
+    void Reset(VertexId from, VertexId to) {
+        const size_t index = GetIndex(from, to);
+        weights_.SetUnreachable(index);
+        prev_edges_[index] = UNREACHABLE;
+    }
+
+    // прямой доступ к столбцам - для вычислительных ядер
+    RouteWeightColumns<Weight>& GetWeightColumns() {
+        return weights_;
+    }
+    const RouteWeightColumns<Weight>& GetWeightColumns() const {
+        return weights_;
+    }
+    std::vector<uint32_t>& GetPrevEdges() {
+        return prev_edges_;
+    }
+    const std::vector<uint32_t>& GetPrevEdges() const {
+        return prev_edges_;
+    }
+
+    // дописывает вершины в конец: старые ячейки сохраняются, новые - недостижимы
+    void AddVertices(size_t count) {
+        RoutesMatrix extended(vertex_count_ + count);
+        extended.CopyBlock(*this, 0);
+        *this = std::move(extended);
+    }
+
+    // копирует матрицу source в квадрат [offset, offset + n) x [offset, offset + n)
+    void CopyBlock(const RoutesMatrix& source, VertexId offset) {
+        if (offset + source.vertex_count_ > vertex_count_) {
+            throw std::out_of_range("Routes matrix block doesn't fit");
+        }
+        for (VertexId from = 0; from < source.vertex_count_; ++from) {
+            for (VertexId to = 0; to < source.vertex_count_; ++to) {
+                const size_t source_index = source.GetIndex(from, to);
+                const size_t index = GetIndex(offset + from, offset + to);
+                weights_.Set(index, source.weights_.Get(source_index));
+                prev_edges_[index] = source.prev_edges_[source_index];
+            }
+        }
+    }
+
+    // перенумерация ребер графа: new_to_old[new_edge_id] = old_edge_id
+    void RenumberEdges(const std::vector<EdgeId>& new_to_old) {
+        std::vector<uint32_t> old_to_new(new_to_old.size());
+        for (EdgeId new_edge_id = 0; new_edge_id < new_to_old.size(); ++new_edge_id) {
+            old_to_new.at(new_to_old[new_edge_id]) = EncodePrevEdge(new_edge_id);
+        }
+        for (uint32_t& prev_edge : prev_edges_) {
+            if (prev_edge != NO_EDGE && prev_edge != UNREACHABLE) {
+                prev_edge = old_to_new.at(prev_edge);
+            }
+        }
+    }
+
+    static uint32_t EncodePrevEdge(std::optional<EdgeId> prev_edge) {
+        if (!prev_edge) {
+            return NO_EDGE;
+        }
+        if (*prev_edge > MAX_EDGE_ID) {
+            throw std::overflow_error("EdgeId doesn't fit routes matrix");
+        }
+        return static_cast<uint32_t>(*prev_edge);
+    }
+
+private:
+    size_t vertex_count_ = 0;
+    RouteWeightColumns<Weight> weights_;
+    std::vector<uint32_t> prev_edges_;
+};
+
+// Матрица маршрутов по компонентам связности графа (без учета направления ребер).
+// Маршрут не выходит за пределы компоненты, поэтому хранятся только блоки на
+// диагонали: для компоненты из n вершин - RoutesMatrix n x n с локальной нумерацией.
+// Вершины разных компонент недостижимы друг из друга - без обращения к блокам.
+template <typename Weight>
+class ComponentRoutesMatrix {
+public:
+    ComponentRoutesMatrix() = default;
+    // component_vertices[c] - вершины компоненты c в порядке их номеров в блоке;
+    // каждая вершина графа - ровно в одной компоненте
+    ComponentRoutesMatrix(size_t vertex_count, std::vector<std::vector<VertexId>> component_vertices)
+        : vertex_components_(vertex_count, NO_COMPONENT)
+        , local_vertices_(vertex_count)
+        , component_vertices_(std::move(component_vertices)) {
+        blocks_.reserve(component_vertices_.size());
+        for (size_t component = 0; component < component_vertices_.size(); ++component) {
+            const std::vector<VertexId>& vertices = component_vertices_[component];
+            for (size_t local = 0; local < vertices.size(); ++local) {
+                if (vertices[local] >= vertex_count || vertex_components_[vertices[local]] != NO_COMPONENT) {
+                    throw std::invalid_argument("Bad routes matrix components");
+                }
+                vertex_components_[vertices[local]] = static_cast<uint32_t>(component);
+                local_vertices_[vertices[local]] = static_cast<uint32_t>(local);
+            }
+            blocks_.emplace_back(vertices.size());
+        }
+        for (const uint32_t component : vertex_components_) {
+            if (component == NO_COMPONENT) {
+                throw std::invalid_argument("Bad routes matrix components");
+            }
+        }
+    }
+
+    size_t GetVertexCount() const {
+        return vertex_components_.size();
+    }
+    size_t GetComponentCount() const {
+        return blocks_.size();
+    }
+    size_t GetComponent(VertexId vertex) const {
+        return vertex_components_[vertex];
+    }
+    // номер вершины внутри блока ее компоненты
+    VertexId GetLocalVertex(VertexId vertex) const {
+        return local_vertices_[vertex];
+    }
+    const std::vector<VertexId>& GetComponentVertices(size_t component) const {
+        return component_vertices_[component];
+    }
+    RoutesMatrix<Weight>& GetBlock(size_t component) {
+        return blocks_[component];
+    }
+    const RoutesMatrix<Weight>& GetBlock(size_t component) const {
+        return blocks_[component];
+    }
+    // суммарное число ячеек блоков
+    size_t GetCellCount() const {
+        size_t cell_count = 0;
+        for (const RoutesMatrix<Weight>& block : blocks_) {
+            cell_count += block.GetVertexCount() * block.GetVertexCount();
+        }
+        return cell_count;
+    }
+
+    bool IsReachable(VertexId from, VertexId to) const {
+        return vertex_components_[from] == vertex_components_[to]
+            && blocks_[vertex_components_[from]].IsReachable(local_vertices_[from], local_vertices_[to]);
+    }
+
+    // только для достижимой пары
+    Weight GetWeight(VertexId from, VertexId to) const {
+        return blocks_[vertex_components_[from]].GetWeight(local_vertices_[from], local_vertices_[to]);
+    }
+
+    std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+        if (vertex_components_[from] != vertex_components_[to]) {
+            return std::nullopt;
+        }
+        return blocks_[vertex_components_[from]].GetPrevEdge(local_vertices_[from], local_vertices_[to]);
+    }
+
+    std::optional<RouteInternalData<Weight>> Get(VertexId from, VertexId to) const {
+        if (vertex_components_[from] != vertex_components_[to]) {
+            return std::nullopt;
+        }
+        return blocks_[vertex_components_[from]].Get(local_vertices_[from], local_vertices_[to]);
+    }
+
+    void Set(VertexId from, VertexId to, const RouteInternalData<Weight>& data) {
+        if (vertex_components_[from] != vertex_components_[to]) {
+            throw std::logic_error("Route between different components");
+        }
+        blocks_[vertex_components_[from]].Set(local_vertices_[from], local_vertices_[to], data);
+    }
+
+    // новые вершины - отдельные компоненты из одной вершины
+    void AddVertices(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const VertexId vertex = vertex_components_.size();
+            vertex_components_.push_back(static_cast<uint32_t>(blocks_.size()));
+            local_vertices_.push_back(0);
+            component_vertices_.push_back({vertex});
+            blocks_.emplace_back(1);
+        }
+    }
+
+    // Объединяет компоненты (после добавления ребер между ними):
+    // merged_components[c] - новый номер компоненты c, номера новых компонент - подряд с 0.
+    // Вершины объединяемых компонент идут в порядке их старых номеров,
+    // ячейки между вершинами разных старых компонент - недостижимы.
+    void MergeComponents(const std::vector<size_t>& merged_components) {
+        if (merged_components.size() != blocks_.size()) {
+            throw std::invalid_argument("Bad routes matrix components");
+        }
+        const size_t merged_count = merged_components.empty()
+            ? 0
+            : *std::max_element(merged_components.begin(), merged_components.end()) + 1;
+        std::vector<std::vector<VertexId>> merged_vertices(merged_count);
+        for (size_t component = 0; component < blocks_.size(); ++component) {
+            std::vector<VertexId>& vertices = merged_vertices[merged_components[component]];
+            vertices.insert(vertices.end(), component_vertices_[component].begin(), component_vertices_[component].end());
+        }
+
+        std::vector<RoutesMatrix<Weight>> merged_blocks;
+        merged_blocks.reserve(merged_count);
+        for (const std::vector<VertexId>& vertices : merged_vertices) {
+            merged_blocks.emplace_back(vertices.size());
+        }
+        std::vector<VertexId> block_offsets(merged_count, 0);
+        for (size_t component = 0; component < blocks_.size(); ++component) {
+            const size_t merged = merged_components[component];
+            if (merged_vertices[merged].size() == component_vertices_[component].size()) {
+                merged_blocks[merged] = std::move(blocks_[component]);
+            } else {
+                merged_blocks[merged].CopyBlock(blocks_[component], block_offsets[merged]);
+            }
+            block_offsets[merged] += component_vertices_[component].size();
+        }
+
+        for (size_t component = 0; component < merged_count; ++component) {
+            for (size_t local = 0; local < merged_vertices[component].size(); ++local) {
+                vertex_components_[merged_vertices[component][local]] = static_cast<uint32_t>(component);
+                local_vertices_[merged_vertices[component][local]] = static_cast<uint32_t>(local);
+            }
+        }
+        component_vertices_ = std::move(merged_vertices);
+        blocks_ = std::move(merged_blocks);
+    }
+
+    // перенумерация ребер графа: new_to_old[new_edge_id] = old_edge_id
+    void RenumberEdges(const std::vector<EdgeId>& new_to_old) {
+        for (RoutesMatrix<Weight>& block : blocks_) {
+            block.RenumberEdges(new_to_old);
+        }
+    }
+
+private:
+    static constexpr uint32_t NO_COMPONENT = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> vertex_components_;
+    std::vector<uint32_t> local_vertices_;
+    std::vector<std::vector<VertexId>> component_vertices_;
+    std::vector<RoutesMatrix<Weight>> blocks_;
+};
+
+}  // namespace graph
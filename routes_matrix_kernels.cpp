@@ -0,0 +1,168 @@
+#include "routes_matrix_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ROUTE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace graph {
+
+namespace {
+
+// параметры релаксации одной строки матрицы маршрутов
+struct RelaxRowTask {
+    double* time;
+    uint16_t* span;
+    uint32_t* prev_edges;
+    size_t row_from;
+    size_t row_through;
+    double time_from;
+    int span_from;
+    uint32_t prev_edge_from;
+};
+
+[[noreturn]] void ThrowSpanOverflow() {
+    throw std::overflow_error("Route span doesn't fit routes matrix");
+}
+
+void RelaxCell(const RelaxRowTask& task, size_t column) {
+    const double candidate_time = task.time_from + task.time[task.row_through + column];
+    if (!(candidate_time < task.time[task.row_from + column])) {
+        return;
+    }
+    const int candidate_span = task.span_from + task.span[task.row_through + column];
+    if (candidate_span > std::numeric_limits<uint16_t>::max()) {
+        ThrowSpanOverflow();
+    }
+    const uint32_t prev_edge_to = task.prev_edges[task.row_through + column];
+    task.time[task.row_from + column] = candidate_time;
+    task.span[task.row_from + column] = static_cast<uint16_t>(candidate_span);
+    task.prev_edges[task.row_from + column] =
+        prev_edge_to != RoutePrevEdge::NO_EDGE ? prev_edge_to : task.prev_edge_from;
+}
+
+void RelaxRowScalar(const RelaxRowTask& task, size_t column_begin, size_t column_end) {
+    for (size_t column = column_begin; column < column_end; ++column) {
+        RelaxCell(task, column);
+    }
+}
+
+#ifdef ROUTE_KERNELS_X86
+
+// 4 ячейки за шаг; маски сравнения 64-битные, для prev_edge и span сжимаются до 32 бит
+__attribute__((target("avx2")))
+void RelaxRowAvx2(const RelaxRowTask& task, size_t column_begin, size_t column_end) {
+    constexpr size_t LANES = 4;
+    const __m256d time_from = _mm256_set1_pd(task.time_from);
+    const __m128i span_from = _mm_set1_epi32(task.span_from);
+    const __m128i max_span = _mm_set1_epi32(std::numeric_limits<uint16_t>::max());
+    const __m128i prev_edge_from = _mm_set1_epi32(static_cast<int>(task.prev_edge_from));
+    const __m128i no_edge = _mm_set1_epi32(static_cast<int>(RoutePrevEdge::NO_EDGE));
+    const __m256i even_lanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+    size_t column = column_begin;
+    for (; column + LANES <= column_end; column += LANES) {
+        const size_t from = task.row_from + column;
+        const size_t through = task.row_through + column;
+
+        const __m256d candidate_time = _mm256_add_pd(time_from, _mm256_loadu_pd(task.time + through));
+        const __m256d improved = _mm256_cmp_pd(candidate_time, _mm256_loadu_pd(task.time + from), _CMP_LT_OQ);
+        if (_mm256_movemask_pd(improved) == 0) {
+            continue;
+        }
+        const __m128i mask = _mm256_castsi256_si128(
+            _mm256_permutevar8x32_epi32(_mm256_castpd_si256(improved), even_lanes));
+
+        const __m128i candidate_span = _mm_add_epi32(
+            _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(task.span + through))),
+            span_from);
+        if (_mm_movemask_epi8(_mm_and_si128(mask, _mm_cmpgt_epi32(candidate_span, max_span))) != 0) {
+            ThrowSpanOverflow();
+        }
+        const __m128i current_span =
+            _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(task.span + from)));
+        const __m128i new_span = _mm_blendv_epi8(current_span, candidate_span, mask);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(task.span + from), _mm_packus_epi32(new_span, new_span));
+
+        const __m128i prev_edge_to = _mm_loadu_si128(reinterpret_cast<const __m128i*>(task.prev_edges + through));
+        const __m128i candidate_prev_edge =
+            _mm_blendv_epi8(prev_edge_to, prev_edge_from, _mm_cmpeq_epi32(prev_edge_to, no_edge));
+        const __m128i current_prev_edge = _mm_loadu_si128(reinterpret_cast<const __m128i*>(task.prev_edges + from));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(task.prev_edges + from),
+                         _mm_blendv_epi8(current_prev_edge, candidate_prev_edge, mask));
+
+        _mm256_storeu_pd(task.time + from, _mm256_blendv_pd(_mm256_loadu_pd(task.time + from), candidate_time, improved));
+    }
+    RelaxRowScalar(task, column, column_end);
+}
+
+// 8 ячеек за шаг, запись по маске без смешивания
+__attribute__((target("avx512f,avx512vl,avx512bw")))
+void RelaxRowAvx512(const RelaxRowTask& task, size_t column_begin, size_t column_end) {
+    constexpr size_t LANES = 8;
+    const __m512d time_from = _mm512_set1_pd(task.time_from);
+    const __m256i span_from = _mm256_set1_epi32(task.span_from);
+    const __m256i max_span = _mm256_set1_epi32(std::numeric_limits<uint16_t>::max());
+    const __m256i prev_edge_from = _mm256_set1_epi32(static_cast<int>(task.prev_edge_from));
+    const __m256i no_edge = _mm256_set1_epi32(static_cast<int>(RoutePrevEdge::NO_EDGE));
+
+    size_t column = column_begin;
+    for (; column + LANES <= column_end; column += LANES) {
+        const size_t from = task.row_from + column;
+        const size_t through = task.row_through + column;
+
+        const __m512d candidate_time = _mm512_add_pd(time_from, _mm512_loadu_pd(task.time + through));
+        const __mmask8 improved = _mm512_cmp_pd_mask(candidate_time, _mm512_loadu_pd(task.time + from), _CMP_LT_OQ);
+        if (improved == 0) {
+            continue;
+        }
+
+        const __m256i candidate_span = _mm256_add_epi32(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(task.span + through))),
+            span_from);
+        if (_mm256_mask_cmpgt_epu32_mask(improved, candidate_span, max_span) != 0) {
+            ThrowSpanOverflow();
+        }
+        _mm_mask_storeu_epi16(task.span + from, improved, _mm256_cvtepi32_epi16(candidate_span));
+
+        const __m256i prev_edge_to = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(task.prev_edges + through));
+        const __m256i candidate_prev_edge = _mm256_mask_blend_epi32(
+            _mm256_cmpeq_epi32_mask(prev_edge_to, no_edge), prev_edge_to, prev_edge_from);
+        _mm256_mask_storeu_epi32(task.prev_edges + from, improved, candidate_prev_edge);
+
+        _mm512_mask_storeu_pd(task.time + from, improved, candidate_time);
+    }
+    RelaxRowScalar(task, column, column_end);
+}
+
+#endif  // ROUTE_KERNELS_X86
+
+using RelaxRowKernel = void (*)(const RelaxRowTask&, size_t, size_t);
+
+RelaxRowKernel SelectRelaxRowKernel() {
+#ifdef ROUTE_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+        && __builtin_cpu_supports("avx512bw")) {
+        return RelaxRowAvx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return RelaxRowAvx2;
+    }
+#endif
+    return RelaxRowScalar;
+}
+
+}  // namespace
+
+void RouteWeightColumns<BusRouteWeight>::RelaxRow(std::vector<uint32_t>& prev_edges, size_t row_from,
+                                                  size_t row_through, const BusRouteWeight& weight_from,
+                                                  uint32_t prev_edge_from, size_t column_begin,
+                                                  size_t column_end) {
+    static const RelaxRowKernel kernel = SelectRelaxRowKernel();
+    kernel(RelaxRowTask{time.data(), span.data(), prev_edges.data(), row_from, row_through,
+                        weight_from.time, weight_from.span, prev_edge_from},
+           column_begin, column_end);
+}
+
+}  // namespace graph
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "domain.h"
+#include "routes_matrix.h"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// В матрице маршрутов время и число пролетов хранятся отдельными массивами.
+// Недостижимая ячейка имеет бесконечное время.
+// Специализация должна быть видна везде, где используется RoutesMatrix<BusRouteWeight>:
+// transport_router.h включает этот файл раньше заголовков маршрутизаторов.
+namespace graph {
+template <>
+struct RouteWeightColumns<BusRouteWeight> {
+    std::vector<double> time;
+    std::vector<uint16_t> span;
+
+    void Resize(size_t size) {
+        time.resize(size, std::numeric_limits<double>::infinity());
+        span.resize(size, 0);
+    }
+    BusRouteWeight Get(size_t index) const {
+        return {time[index], span[index]};
+    }
+    void Set(size_t index, const BusRouteWeight& weight) {
+        if (weight.span < 0 || weight.span > std::numeric_limits<uint16_t>::max()) {
+            throw std::overflow_error("Route span doesn't fit routes matrix");
+        }
+        time[index] = weight.time;
+        span[index] = static_cast<uint16_t>(weight.span);
+    }
+    void SetUnreachable(size_t index) {
+        time[index] = std::numeric_limits<double>::infinity();
+        span[index] = 0;
+    }
+
+    // Бесконечное время недостижимой ячейки позволяет обойтись без ветвлений:
+    // через недостижимую ячейку кандидат бесконечен и ничего не заменяет,
+    // а любой конечный кандидат короче недостижимой ячейки.
+    // Реализация векторизована (AVX-512 / AVX2), набор команд выбирается
+    // при запуске, без них - скалярный цикл (routes_matrix_kernels.cpp).
+    void RelaxRow(std::vector<uint32_t>& prev_edges, size_t row_from, size_t row_through,
+                  const BusRouteWeight& weight_from, uint32_t prev_edge_from,
+                  size_t column_begin, size_t column_end);
+};
+} // namespace graph
@@ -1,12 +1,257 @@
 #include "serialization.h"
 
+#include <google/protobuf/wire_format_lite.h>
+
+#include <algorithm>
+#include <climits>
+#include <string>
+
 namespace Serialize
 {
 
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+// Читает длину и поля вложенного сообщения; on_field(tag, input) читает поле целиком
+template <typename FieldReader>
+bool ReadMessageFields(google::protobuf::io::CodedInputStream& input, FieldReader on_field) {
+    uint32_t size = 0;
+    if(!input.ReadVarint32(&size)) {
+        return false;
+    }
+    const auto limit = input.PushLimit(static_cast<int>(size));
+    for(uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+        if(!on_field(tag, input)) {
+            return false;
+        }
+    }
+    if(!input.ConsumedEntireMessage()) {
+        return false;
+    }
+    input.PopLimit(limit);
+    return true;
+}
+
+// Поля router по порядку всех его вхождений в файл базы. База с оглавлением читается
+// из своего отображения: файл по пути мог быть уже заменен новой базой.
+// Каждое вхождение - своим потоком, ограниченным его длиной (не больше INT_MAX).
+template <typename FieldReader>
+void ReadRouterFields(const graph::MappedFile* file, const std::filesystem::path& path,
+                      const std::vector<RouterSection>& router_sections, FieldReader on_field) {
+    if(file) {
+        const auto* data = reinterpret_cast<const uint8_t*>(file->GetData());
+        for(const RouterSection& section : router_sections) {
+            google::protobuf::io::CodedInputStream input(data + section.offset, static_cast<int>(section.size));
+            if(!ReadMessageFields(input, on_field)) {
+                throw std::runtime_error("Bad base file");
+            }
+        }
+        return;
+    }
+    std::ifstream input_file(path, std::ios::binary);
+    if(!input_file) {
+        throw std::runtime_error("Can't open file? bad path?");
+    }
+    for(const RouterSection& section : router_sections) {
+        input_file.clear();
+        input_file.seekg(static_cast<std::streamoff>(section.offset));
+        google::protobuf::io::IstreamInputStream raw_input(&input_file);
+        google::protobuf::io::CodedInputStream input(&raw_input);
+        input.SetTotalBytesLimit(static_cast<int>(section.size));
+        if(!ReadMessageFields(input, on_field)) {
+            throw std::runtime_error("Bad base file");
+        }
+    }
+}
+
+} // namespace
+
+void Deserializer::Load() {
+    if(MappedBase::IsMappedBase(open_path_)) {
+        mapped_base_ = std::make_unique<MappedBase>(open_path_);
+        const std::string_view pb_section = mapped_base_->GetProtobufSection();
+        if(!pb_base_.ParseFromArray(pb_section.data(), static_cast<int>(pb_section.size()))) {
+            throw std::runtime_error("Bad base file");
+        }
+        routes_file_ = pb_base_.router().routes_file();
+        router_scanned_ = true;
+        return;
+    }
+    if(LoadIndex()) {
+        return;
+    }
+    // без оглавления база разбирается одним CodedInputStream, длина которого - int
+    if(std::filesystem::file_size(open_path_) > static_cast<uintmax_t>(INT_MAX)) {
+        throw std::runtime_error("Base file without index is larger than 2 GB: rebuild it with make_base");
+    }
+    std::ifstream input_file(open_path_, std::ios::binary);
+    if(!input_file) {
+        throw std::runtime_error("Can't open file? bad path?");
+    }
+    google::protobuf::io::IstreamInputStream raw_input(&input_file);
+    google::protobuf::io::CodedInputStream input(&raw_input);
+    input.SetTotalBytesLimit(INT_MAX);
+
+    // поле за полем: в памяти одновременно - разобранная часть базы и одно поле
+    std::string field;
+    for(uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+        if(WireFormatLite::GetTagFieldNumber(tag) == tc_pb::TransportBase::kRouterFieldNumber
+           && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            // строки матрицы пропускаются, их читает GetRouter
+            const int offset = input.CurrentPosition();
+            const bool parsed = ReadMessageFields(input,
+                [this](uint32_t router_tag, google::protobuf::io::CodedInputStream& router_input) {
+                    return ReadRouterField(router_tag, router_input);
+                });
+            if(!parsed) {
+                throw std::runtime_error("Bad base file");
+            }
+            router_sections_.push_back({static_cast<uint64_t>(offset), static_cast<uint64_t>(input.CurrentPosition() - offset)});
+            continue;
+        }
+        field.clear();
+        {
+            google::protobuf::io::StringOutputStream raw_field(&field);
+            google::protobuf::io::CodedOutputStream field_output(&raw_field);
+            if(!WireFormatLite::SkipField(&input, tag, &field_output)) {
+                throw std::runtime_error("Bad base file");
+            }
+        }
+        if(!pb_base_.MergeFromString(field)) {
+            throw std::runtime_error("Bad base file");
+        }
+    }
+    if(!input.ConsumedEntireMessage()) {
+        throw std::runtime_error("Bad base file");
+    }
+    router_scanned_ = true;
+}
+
+bool Deserializer::LoadIndex() {
+    auto file = std::make_unique<graph::MappedFile>(open_path_);
+    const auto* data = reinterpret_cast<const uint8_t*>(file->GetData());
+    const size_t size = file->GetSize();
+
+    // последняя запись - тег index_offset и 8 байт значения
+    const size_t index_offset_size = WireFormatLite::TagSize(tc_pb::TransportBase::kIndexOffsetFieldNumber,
+                                                             WireFormatLite::TYPE_FIXED64) + sizeof(uint64_t);
+    if(size < index_offset_size) {
+        return false;
+    }
+    google::protobuf::io::CodedInputStream index_offset_input(data + size - index_offset_size,
+                                                               static_cast<int>(index_offset_size));
+    uint64_t index_offset = 0;
+    if(index_offset_input.ReadTag() != WireFormatLite::MakeTag(tc_pb::TransportBase::kIndexOffsetFieldNumber,
+                                                               WireFormatLite::WIRETYPE_FIXED64)
+       || !index_offset_input.ReadLittleEndian64(&index_offset)
+       || index_offset >= size - index_offset_size) {
+        return false;
+    }
+
+    // за index_offset должна идти запись index ровно до последней записи
+    if(size - index_offset_size - index_offset > static_cast<uint64_t>(INT_MAX)) {
+        throw std::runtime_error("Bad base file");
+    }
+    const int index_size = static_cast<int>(size - index_offset_size - index_offset);
+    google::protobuf::io::CodedInputStream index_input(data + index_offset, index_size);
+    if(index_input.ReadTag() != WireFormatLite::MakeTag(tc_pb::TransportBase::kIndexFieldNumber,
+                                                        WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+       || !WireFormatLite::ReadMessage(&index_input, &pb_index_)
+       || index_input.CurrentPosition() != index_size) {
+        pb_index_.Clear();
+        return false;
+    }
+
+    const size_t router_tag_size = WireFormatLite::TagSize(tc_pb::TransportBase::kRouterFieldNumber,
+                                                           WireFormatLite::TYPE_MESSAGE);
+    for(const tc_pb::BaseSection& pb_section : pb_index_.sections()) {
+        // запись читается одним CodedInputStream
+        if(pb_section.offset() > index_offset || pb_section.size() > index_offset - pb_section.offset()
+           || pb_section.size() > static_cast<uint64_t>(INT_MAX)) {
+            throw std::runtime_error("Bad base file");
+        }
+        if(pb_section.field_number() == tc_pb::TransportBase::kRouterFieldNumber) {
+            if(pb_section.size() < router_tag_size) {
+                throw std::runtime_error("Bad base file");
+            }
+            router_sections_.push_back({pb_section.offset() + router_tag_size, pb_section.size() - router_tag_size});
+        }
+    }
+    file_ = std::move(file);
+    return true;
+}
+
+const tc_pb::TransportBase& Deserializer::GetSection(int field_number) const {
+    ThrowIfLoadingCancelled();
+    if(!file_) {
+        // разобрана целиком в Load()
+        return pb_base_;
+    }
+    std::lock_guard<std::mutex> lock(sections_mutex_);
+    if(const auto it = sections_.find(field_number); it != sections_.end()) {
+        return it->second;
+    }
+    const auto* data = reinterpret_cast<const uint8_t*>(file_->GetData());
+    tc_pb::TransportBase pb_section;
+    for(const tc_pb::BaseSection& pb_index_section : pb_index_.sections()) {
+        if(static_cast<int>(pb_index_section.field_number()) != field_number) {
+            continue;
+        }
+        google::protobuf::io::CodedInputStream input(data + pb_index_section.offset(),
+                                                     static_cast<int>(pb_index_section.size()));
+        if(!pb_section.MergeFromCodedStream(&input)) {
+            throw std::runtime_error("Bad base file");
+        }
+    }
+    return sections_.emplace(field_number, std::move(pb_section)).first->second;
+}
+
+void Deserializer::ThrowIfLoadingCancelled() const {
+    if(loading_cancelled_) {
+        throw std::runtime_error("Base loading cancelled");
+    }
+}
+
+void Deserializer::ScanRouterSections() const {
+    std::lock_guard<std::mutex> lock(sections_mutex_);
+    if(router_scanned_) {
+        return;
+    }
+    // в отображении пропуск строк матрицы - сдвиг указателя, без чтения
+    const auto* data = reinterpret_cast<const uint8_t*>(file_->GetData());
+    for(const RouterSection& section : router_sections_) {
+        google::protobuf::io::CodedInputStream input(data + section.offset, static_cast<int>(section.size));
+        const bool parsed = ReadMessageFields(input,
+            [this](uint32_t tag, google::protobuf::io::CodedInputStream& router_input) {
+                return ReadRouterField(tag, router_input);
+            });
+        if(!parsed) {
+            throw std::runtime_error("Bad base file");
+        }
+    }
+    router_scanned_ = true;
+}
+
+bool Deserializer::ReadRouterField(uint32_t tag, google::protobuf::io::CodedInputStream& input) const {
+    const int field_number = WireFormatLite::GetTagFieldNumber(tag);
+    if(field_number == tc_pb::Router::kRoutesFileFieldNumber) {
+        return WireFormatLite::ReadString(&input, &routes_file_);
+    }
+    if(field_number == tc_pb::Router::kComponentsFieldNumber
+       || field_number == tc_pb::Router::kRoutesInternalDataFieldNumber) {
+        has_routes_matrix_ = true;
+    }
+    return WireFormatLite::SkipField(&input, tag);
+}
+
 catalogue::TransportCatalogue Deserializer::GetTransportCatalogue() const {
+    if(mapped_base_) {
+        return mapped_base_->GetTransportCatalogue();
+    }
     catalogue::TransportCatalogue result;
    
-    const tc_pb::TransportCatalogue& pb_catalogue = pb_base_.cat();
+    const tc_pb::TransportCatalogue& pb_catalogue = GetSection(tc_pb::TransportBase::kCatFieldNumber).cat();
     
     {
         // остановки
@@ -51,7 +296,8 @@ catalogue::TransportCatalogue Deserializer::GetTransportCatalogue() const {
                 std::string(pb_bus.name()),
                 std::move(stops),
                 bus_type,
-                pb_bus.id()
+                pb_bus.id(),
+                std::vector<double>(pb_bus.departures().begin(), pb_bus.departures().end())
             };
             Bus& emlplaced = buses.emplace_back(std::move(current_bus));
 
@@ -105,9 +351,52 @@ catalogue::TransportCatalogue Deserializer::GetTransportCatalogue() const {
 
 catalogue::RoutingSettings Deserializer::GetRoutingSettings() const {
     catalogue::RoutingSettings result;
+    const tc_pb::RoutingSettings& pb_routing_settings =
+        GetSection(tc_pb::TransportBase::kRoutingSettingsFieldNumber).routing_settings();
+
+    result.bus_velocity = pb_routing_settings.bus_velocity();
+    result.bus_wait_time = pb_routing_settings.bus_wait_time();
 
-    result.bus_velocity = pb_base_.routing_settings().bus_velocity();
-    result.bus_wait_time = pb_base_.routing_settings().bus_wait_time();
+    switch (pb_routing_settings.router_type())
+    {
+    case tc_pb::DIJKSTRA:
+        result.router_type = catalogue::RouterType::DIJKSTRA;
+        break;
+    case tc_pb::CONTRACTION_HIERARCHIES:
+        result.router_type = catalogue::RouterType::CONTRACTION_HIERARCHIES;
+        break;
+    case tc_pb::A_STAR:
+        result.router_type = catalogue::RouterType::A_STAR;
+        break;
+    case tc_pb::HUB_LABELS:
+        result.router_type = catalogue::RouterType::HUB_LABELS;
+        break;
+    case tc_pb::CUSTOMIZABLE_CONTRACTION_HIERARCHIES:
+        result.router_type = catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES;
+        break;
+    default:
+        result.router_type = catalogue::RouterType::ALL_PAIRS;
+        break;
+    }
+    result.router_cache_size = pb_routing_settings.router_cache_size();
+    result.graph_model = pb_routing_settings.graph_model() == tc_pb::SINGLE_VERTEX
+        ? catalogue::GraphModel::SINGLE_VERTEX
+        : catalogue::GraphModel::ARRIVAL_DEPARTURE;
+    switch (pb_routing_settings.vertex_order())
+    {
+    case tc_pb::HILBERT:
+        result.vertex_order = catalogue::VertexOrder::HILBERT;
+        break;
+    case tc_pb::REVERSE_CUTHILL_MCKEE:
+        result.vertex_order = catalogue::VertexOrder::REVERSE_CUTHILL_MCKEE;
+        break;
+    default:
+        result.vertex_order = catalogue::VertexOrder::INPUT;
+        break;
+    }
+    for(const tc_pb::RoutingProfile& pb_profile : pb_routing_settings.profiles()) {
+        result.profiles[pb_profile.name()] = {pb_profile.bus_wait_time(), pb_profile.bus_velocity()};
+    }
 
     return result;
 }
@@ -115,7 +404,8 @@ catalogue::RoutingSettings Deserializer::GetRoutingSettings() const {
 renderer::RenderSettings Deserializer::GetRenderSettings() const {
     renderer::RenderSettings result;
 
-    const tc_pb::RenderSettings& pb_render_settings = pb_base_.rendder_settings();
+    const tc_pb::RenderSettings& pb_render_settings =
+        GetSection(tc_pb::TransportBase::kRendderSettingsFieldNumber).rendder_settings();
 
     result.width = pb_render_settings.width();
     result.height = pb_render_settings.height();
@@ -175,23 +465,25 @@ svg::Color Deserializer::ExtractSVGColorFromPBColor(tc_pb::Color pb_color) {
 catalogue::TransportRouter 
 Deserializer::GetTransportRouter(const catalogue::TransportCatalogue& catalogue) const {
     catalogue::TransportRouter result(GetRoutingSettings(), catalogue);
+    if(mapped_base_) {
+        mapped_base_->FillTransportRouter(catalogue, result);
+        return result;
+    }
 
-    
-
-    
-    
+    const tc_pb::TransportRouter& pb_transport_router =
+        GetSection(tc_pb::TransportBase::kTransportRouterFieldNumber).transport_router();
     std::deque<const Stop*> vertex_index_to_stop;
     std::map<std::string_view, graph::VertexId> stopname_to_vertex_id;
 
-    for(const int32_t stop_id : pb_base_.transport_router().vertex_index_to_stop()) {
+    for(const int32_t stop_id : pb_transport_router.vertex_index_to_stop()) {
         const Stop*& emplaced = vertex_index_to_stop.emplace_back(&catalogue.GetStops().at(stop_id));
 
-        // сомнительный код
-        stopname_to_vertex_id[emplaced->name_] = 2 * stop_id;
+        // первая вершина остановки - "приемная" (или единственная)
+        stopname_to_vertex_id.emplace(emplaced->name_, vertex_index_to_stop.size() - 1);
     }
 
-    std::deque<const Bus*> edge_index_to_bus;
-    for(auto bus_id : pb_base_.transport_router().edge_index_to_bus()) {
+    std::vector<const Bus*> edge_index_to_bus;
+    for(auto bus_id : pb_transport_router.edge_index_to_bus()) {
         if(bus_id.isinitialized()) {
             edge_index_to_bus.emplace_back(&catalogue.GetBuses().at(bus_id.bus_id()));
         } else {
@@ -202,11 +494,18 @@ Deserializer::GetTransportRouter(const catalogue::TransportCatalogue& catalogue)
     result.SetVertexIndexToStop(std::move(vertex_index_to_stop));
     result.SetStopnameToVertexId(std::move(stopname_to_vertex_id));
     result.SetEdgeIndexToBus(std::move(edge_index_to_bus));
-
-    graph::DirectedWeightedGraph<BusRouteWeight> route_graph(vertex_index_to_stop.size());
-    for(const auto& pb_edge : pb_base_.transport_router().route_graph().edges()) {
-        
-        route_graph.AddEdge(
+    if(result.GetRoutingSettings().graph_model == catalogue::GraphModel::SINGLE_VERTEX
+        && pb_transport_router.edge_index_to_ride_time_size() != pb_transport_router.edge_index_to_bus_size()) {
+        throw std::runtime_error("Bad base file");
+    }
+    result.SetEdgeIndexToRideTime(std::vector<double>(pb_transport_router.edge_index_to_ride_time().begin(),
+                                                      pb_transport_router.edge_index_to_ride_time().end()));
+
+    const tc_pb::DirectedWeightedGraph& pb_graph = pb_transport_router.route_graph();
+    std::vector<graph::Edge<BusRouteWeight>> edges;
+    edges.reserve(pb_graph.edges_size());
+    for(const auto& pb_edge : pb_graph.edges()) {
+        edges.push_back(
             graph::Edge<BusRouteWeight>{
                 pb_edge.vertex_id_from(),
                 pb_edge.vertex_id_to(),
@@ -217,47 +516,475 @@ Deserializer::GetTransportRouter(const catalogue::TransportCatalogue& catalogue)
             }
         );
     }
+
+    if(pb_graph.incidence_offsets_size() != 0) {
+        // граф сохранен в CSR - массивы используются как есть
+        std::vector<graph::EdgeId> incidence_offsets(pb_graph.incidence_offsets().begin(), pb_graph.incidence_offsets().end());
+        result.SetRouteGraph(graph::DirectedWeightedGraph<BusRouteWeight>(std::move(edges), std::move(incidence_offsets)));
+    } else {
+        graph::DirectedWeightedGraph<BusRouteWeight> route_graph(result.GetVertexIndexToStop().size());
+        for(const auto& edge : edges) {
+            route_graph.AddEdge(edge);
+        }
+        result.SetRouteGraph(std::move(route_graph));
+        // EdgeId в сохраненной матрице маршрутов должны остаться прежними
+        ScanRouterSections();
+        if(!has_routes_matrix_ && routes_file_.empty()) {
+            result.Freeze();
+        }
+    }
     // граф построен
-    result.SetRouteGraph(std::move(route_graph));
 
     return result;
 }
 
-graph::Router<BusRouteWeight> Deserializer::GetRouter(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
-    
-    graph::Router<BusRouteWeight>::RoutesInternalData routes_internal_data;
-    routes_internal_data.resize(graph.GetVertexCount());
-
-    const tc_pb::Router& pb_router = pb_base_.router();
-    size_t from_index = 0;
-    for(const tc_pb::RouteInternalDataRow pb_route_internal_data_row : pb_router.routes_internal_data()) {
-        routes_internal_data[from_index].resize(graph.GetVertexCount());
-        size_t to_index = 0;
-        for(const tc_pb::RouteInternalData& pb_route_internal_data : pb_route_internal_data_row.route_internal_data_row()) {
-            if(pb_route_internal_data.has_weight()) {
-                routes_internal_data[from_index][to_index] = {
-                    {pb_route_internal_data.weight().time(), pb_route_internal_data.weight().span()},
-                    std::nullopt
-                };
-                // routes_internal_data[from_index][to_index].value().weight.time = pb_route_internal_data.weight().time();
-                // routes_internal_data[from_index][to_index].value().weight.span = pb_route_internal_data.weight().span();
-                ;
-                if(pb_route_internal_data.has_prev_edge()) {
-                    routes_internal_data[from_index][to_index].value().prev_edge = pb_route_internal_data.prev_edge().prev_edge_id();
-                    ;
-                }
+namespace {
+
+void FillRoutesRow(const tc_pb::RouteInternalDataRow& pb_row, size_t from_index,
+                   graph::RoutesMatrix<BusRouteWeight>& block) {
+    size_t to_index = 0;
+    for(const tc_pb::RouteInternalData& pb_route_internal_data : pb_row.route_internal_data_row()) {
+        if(pb_route_internal_data.has_weight()) {
+            std::optional<graph::EdgeId> prev_edge;
+            if(pb_route_internal_data.has_prev_edge()) {
+                prev_edge = pb_route_internal_data.prev_edge().prev_edge_id();
             }
+            block.Set(from_index, to_index, {
+                {pb_route_internal_data.weight().time(), pb_route_internal_data.weight().span()},
+                prev_edge
+            });
+        }
 
-            ++to_index;
+        ++to_index;
+    }
+}
+
+void FillRoutesRow(const tc_pb::PackedRouteRow& pb_row, size_t from_index,
+                   graph::RoutesMatrix<BusRouteWeight>& block) {
+    // по значению на каждый установленный бит reachable: иначе база повреждена
+    const std::string& reachable = pb_row.reachable();
+    const size_t column_count = block.GetVertexCount();
+    const int value_count = pb_row.times_size();
+    if(reachable.size() != (column_count + 7) / 8
+       || pb_row.spans_size() != value_count || pb_row.prev_edge_deltas_size() != value_count) {
+        throw std::runtime_error("Bad base file");
+    }
+    int value = 0;
+    int64_t prev_edge_code = 0;
+    for(size_t to_index = 0; to_index < column_count; ++to_index) {
+        if((static_cast<unsigned char>(reachable[to_index / 8]) & (1u << (to_index % 8))) == 0) {
+            continue;
+        }
+        if(value == value_count) {
+            throw std::runtime_error("Bad base file");
         }
+        prev_edge_code += pb_row.prev_edge_deltas(value);
+        std::optional<graph::EdgeId> prev_edge;
+        if(prev_edge_code != 0) {
+            prev_edge = static_cast<graph::EdgeId>(prev_edge_code - 1);
+        }
+        block.Set(from_index, to_index, {{pb_row.times(value), pb_row.spans(value)}, prev_edge});
+        ++value;
+    }
+    if(value != value_count) {
+        throw std::runtime_error("Bad base file");
+    }
+}
 
-        ++from_index;
+// вершины компоненты: упакованные или по одной
+bool ReadComponentVertices(uint32_t tag, google::protobuf::io::CodedInputStream& input,
+                           std::vector<graph::VertexId>& vertices) {
+    uint32_t vertex = 0;
+    if(WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_VARINT) {
+        if(!input.ReadVarint32(&vertex)) {
+            return false;
+        }
+        vertices.push_back(vertex);
+        return true;
     }
-    
+    uint32_t size = 0;
+    if(!input.ReadVarint32(&size)) {
+        return false;
+    }
+    const auto limit = input.PushLimit(static_cast<int>(size));
+    while(input.BytesUntilLimit() > 0) {
+        if(!input.ReadVarint32(&vertex)) {
+            return false;
+        }
+        vertices.push_back(vertex);
+    }
+    input.PopLimit(limit);
+    return true;
+}
+
+} // namespace
+
+graph::Router<BusRouteWeight> Deserializer::GetRouter(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
+    if(const auto routes_file = GetRoutesFile()) {
+        // для дополнения базы матрица нужна в памяти целиком
+        return graph::Router<BusRouteWeight>(graph, graph::MappedRoutesMatrix<BusRouteWeight>(*routes_file).Load());
+    }
+    if(mapped_base_ && mapped_base_->HasRoutes()) {
+        return graph::Router<BusRouteWeight>(graph, mapped_base_->GetRoutesMatrix().Load());
+    }
+
+    // первый проход - вершины компонент: блоки нужны раньше строк,
+    // а строки компоненты лежат до вершин следующей
+    std::vector<std::vector<graph::VertexId>> component_vertices;
+    ReadRouterFields(file_.get(), open_path_, router_sections_,
+        [&component_vertices](uint32_t tag, google::protobuf::io::CodedInputStream& input) {
+            if(WireFormatLite::GetTagFieldNumber(tag) != tc_pb::Router::kComponentsFieldNumber) {
+                return WireFormatLite::SkipField(&input, tag);
+            }
+            std::vector<graph::VertexId>& vertices = component_vertices.emplace_back();
+            return ReadMessageFields(input,
+                [&vertices](uint32_t component_tag, google::protobuf::io::CodedInputStream& component_input) {
+                    if(WireFormatLite::GetTagFieldNumber(component_tag) != tc_pb::RouterComponent::kVerticesFieldNumber) {
+                        return WireFormatLite::SkipField(&component_input, component_tag);
+                    }
+                    return ReadComponentVertices(component_tag, component_input, vertices);
+                });
+        });
+
+    const bool has_components = !component_vertices.empty();
+    if(!has_components) {
+        // прежний формат: одна компонента из всех вершин
+        std::vector<graph::VertexId> vertices(graph.GetVertexCount());
+        for(graph::VertexId vertex = 0; vertex < vertices.size(); ++vertex) {
+            vertices[vertex] = vertex;
+        }
+        component_vertices.push_back(std::move(vertices));
+    }
+
+    graph::Router<BusRouteWeight>::RoutesInternalData routes_internal_data(graph.GetVertexCount(), std::move(component_vertices));
+
+    // второй проход - строки по одной прямо в блоки
+    tc_pb::RouteInternalDataRow pb_row;
+    tc_pb::PackedRouteRow pb_packed_row;
+    size_t component = 0;
+    size_t legacy_from_index = 0;
+    ReadRouterFields(file_.get(), open_path_, router_sections_,
+        [&](uint32_t tag, google::protobuf::io::CodedInputStream& input) {
+            const int field_number = WireFormatLite::GetTagFieldNumber(tag);
+            if(field_number == tc_pb::Router::kRoutesInternalDataFieldNumber && !has_components) {
+                pb_row.Clear();
+                if(!WireFormatLite::ReadMessage(&input, &pb_row)) {
+                    return false;
+                }
+                ThrowIfLoadingCancelled();
+                FillRoutesRow(pb_row, legacy_from_index++, routes_internal_data.GetBlock(0));
+                return true;
+            }
+            if(field_number != tc_pb::Router::kComponentsFieldNumber) {
+                return WireFormatLite::SkipField(&input, tag);
+            }
+            graph::RoutesMatrix<BusRouteWeight>& block = routes_internal_data.GetBlock(component++);
+            size_t from_index = 0;
+            return ReadMessageFields(input,
+                [&](uint32_t component_tag, google::protobuf::io::CodedInputStream& component_input) {
+                    const int component_field_number = WireFormatLite::GetTagFieldNumber(component_tag);
+                    if(component_field_number == tc_pb::RouterComponent::kRowsFieldNumber) {
+                        pb_packed_row.Clear();
+                        if(!WireFormatLite::ReadMessage(&component_input, &pb_packed_row)) {
+                            return false;
+                        }
+                        ThrowIfLoadingCancelled();
+                        FillRoutesRow(pb_packed_row, from_index++, block);
+                        return true;
+                    }
+                    if(component_field_number != tc_pb::RouterComponent::kRoutesInternalDataFieldNumber) {
+                        return WireFormatLite::SkipField(&component_input, component_tag);
+                    }
+                    pb_row.Clear();
+                    if(!WireFormatLite::ReadMessage(&component_input, &pb_row)) {
+                        return false;
+                    }
+                    ThrowIfLoadingCancelled();
+                    FillRoutesRow(pb_row, from_index++, block);
+                    return true;
+                });
+        });
+
     graph::Router<BusRouteWeight> result(graph, std::move(routes_internal_data));
 
     return result;
 }
 
+namespace {
+
+graph::HubLabels<BusRouteWeight>::LabelSet ConvertPBHubLabelSet(const tc_pb::HubLabelSet& pb_label_set) {
+    graph::HubLabels<BusRouteWeight>::LabelSet result;
+    result.offsets.assign(pb_label_set.offsets().begin(), pb_label_set.offsets().end());
+    result.labels.reserve(pb_label_set.labels_size());
+    for(const tc_pb::HubLabel& pb_label : pb_label_set.labels()) {
+        result.labels.push_back({
+            pb_label.hub(),
+            pb_label.parent_edge(),
+            BusRouteWeight{pb_label.weight().time(), pb_label.weight().span()}
+        });
+    }
+    return result;
+}
+
+} // namespace
+
+std::unique_ptr<graph::HubLabels<BusRouteWeight>>
+Deserializer::GetHubLabels(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
+    const tc_pb::HubLabels& pb_hub_labels = GetSection(tc_pb::TransportBase::kHubLabelsFieldNumber).hub_labels();
+
+    std::vector<graph::VertexId> order(pb_hub_labels.order().begin(), pb_hub_labels.order().end());
+    return std::make_unique<graph::HubLabels<BusRouteWeight>>(graph, std::move(order),
+        ConvertPBHubLabelSet(pb_hub_labels.out_labels()),
+        ConvertPBHubLabelSet(pb_hub_labels.in_labels()));
+}
+
+std::unique_ptr<graph::CustomizableContractionHierarchy<BusRouteWeight>>
+Deserializer::GetCustomizableContractionHierarchy(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
+    const tc_pb::TransportBase& pb_section = GetSection(tc_pb::TransportBase::kCustomizableContractionHierarchyFieldNumber);
+    if(!pb_section.has_customizable_contraction_hierarchy()) {
+        return nullptr;
+    }
+    const tc_pb::CustomizableContractionHierarchy& pb_cch = pb_section.customizable_contraction_hierarchy();
+
+    std::vector<graph::VertexId> order(pb_cch.order().begin(), pb_cch.order().end());
+    std::vector<uint32_t> arc_offsets(pb_cch.arc_offsets().begin(), pb_cch.arc_offsets().end());
+    std::vector<uint32_t> arc_heads(pb_cch.arc_heads().begin(), pb_cch.arc_heads().end());
+    return std::make_unique<graph::CustomizableContractionHierarchy<BusRouteWeight>>(graph,
+        std::move(order), std::move(arc_offsets), std::move(arc_heads));
+}
+
+std::unique_ptr<catalogue::ConnectionScanRouter>
+Deserializer::GetConnectionScanRouter(const catalogue::TransportCatalogue& catalogue) const {
+    const tc_pb::TransportBase& pb_section = GetSection(tc_pb::TransportBase::kTimetableFieldNumber);
+    if(!pb_section.has_timetable()) {
+        return nullptr;
+    }
+    const tc_pb::Timetable& pb_timetable = pb_section.timetable();
+
+    std::vector<catalogue::TimetableTrip> trips;
+    trips.reserve(pb_timetable.trips_size());
+    for(const tc_pb::TimetableTrip& pb_trip : pb_timetable.trips()) {
+        trips.push_back({&catalogue.GetBuses().at(pb_trip.bus_id()), pb_trip.departure_time()});
+    }
+    std::vector<catalogue::TimetableConnection> connections;
+    connections.reserve(pb_timetable.connections_size());
+    for(const tc_pb::TimetableConnection& pb_connection : pb_timetable.connections()) {
+        connections.push_back({
+            pb_connection.from_stop_id(),
+            pb_connection.to_stop_id(),
+            pb_connection.departure_time(),
+            pb_connection.arrival_time(),
+            pb_connection.trip(),
+            pb_connection.trip_position()
+        });
+    }
+    return std::make_unique<catalogue::ConnectionScanRouter>(catalogue, std::move(trips), std::move(connections));
+}
+
+std::optional<std::filesystem::path> Deserializer::GetRoutesFile() const {
+    ScanRouterSections();
+    if(routes_file_.empty()) {
+        return std::nullopt;
+    }
+    return std::filesystem::path(routes_file_);
+}
+
+bool Deserializer::HasMappedRouter() const {
+    return GetRoutesFile() || (mapped_base_ && mapped_base_->HasRoutes());
+}
+
+std::unique_ptr<graph::MappedRouter<BusRouteWeight>> Deserializer::GetMappedRouter(
+    const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
+    if(const auto routes_file = GetRoutesFile()) {
+        return std::make_unique<graph::MappedRouter<BusRouteWeight>>(graph, *routes_file);
+    }
+    if(mapped_base_ && mapped_base_->HasRoutes()) {
+        return std::make_unique<graph::MappedRouter<BusRouteWeight>>(graph, mapped_base_->GetRoutesMatrix());
+    }
+    throw std::logic_error("Routes matrix is stored in the base, not in a separate file");
+}
+
+std::unique_ptr<graph::ContractionHierarchy<BusRouteWeight>>
+Deserializer::GetContractionHierarchy(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const {
+    using ContractionHierarchy = graph::ContractionHierarchy<BusRouteWeight>;
+
+    const tc_pb::ContractionHierarchy& pb_contraction_hierarchy =
+        GetSection(tc_pb::TransportBase::kContractionHierarchyFieldNumber).contraction_hierarchy();
+
+    std::vector<size_t> ranks(pb_contraction_hierarchy.ranks().begin(), pb_contraction_hierarchy.ranks().end());
+
+    std::vector<ContractionHierarchy::ChEdge> edges;
+    edges.reserve(pb_contraction_hierarchy.edges_size());
+    for(const tc_pb::ChEdge& pb_edge : pb_contraction_hierarchy.edges()) {
+        ContractionHierarchy::ChEdge& edge = edges.emplace_back(ContractionHierarchy::ChEdge{
+            pb_edge.vertex_id_from(),
+            pb_edge.vertex_id_to(),
+            BusRouteWeight{pb_edge.weight().time(), pb_edge.weight().span()}
+        });
+        if(pb_edge.is_shortcut()) {
+            edge.first_child = pb_edge.first_child();
+            edge.second_child = pb_edge.second_child();
+        } else {
+            edge.original_edge = pb_edge.original_edge_id();
+        }
+    }
+
+    return std::make_unique<ContractionHierarchy>(graph, std::move(ranks), std::move(edges));
+}
+
+namespace {
+
+void FillPbRouteRow(const graph::RoutesMatrix<BusRouteWeight>& block, graph::VertexId from,
+                    tc_pb::PackedRouteRow& pb_row) {
+    pb_row.Clear();
+    const size_t vertex_count = block.GetVertexCount();
+    std::string& reachable = *pb_row.mutable_reachable();
+    reachable.assign((vertex_count + 7) / 8, '\0');
+    int64_t prev_edge_code = 0;
+    for (graph::VertexId to = 0; to < vertex_count; ++to) {
+        if(!block.IsReachable(from, to)) {
+            continue;
+        }
+        reachable[to / 8] = static_cast<char>(reachable[to / 8] | (1 << (to % 8)));
+
+        const BusRouteWeight weight = block.GetWeight(from, to);
+        pb_row.add_times(weight.time);
+        pb_row.add_spans(weight.span);
+
+        const auto prev_edge = block.GetPrevEdge(from, to);
+        const int64_t edge_code = prev_edge ? static_cast<int64_t>(*prev_edge) + 1 : 0;
+        pb_row.add_prev_edge_deltas(edge_code - prev_edge_code);
+        prev_edge_code = edge_code;
+    }
+}
+
+size_t PackedVerticesSize(const std::vector<graph::VertexId>& vertices) {
+    size_t size = 0;
+    for(const graph::VertexId vertex : vertices) {
+        size += google::protobuf::io::CodedOutputStream::VarintSize32(static_cast<uint32_t>(vertex));
+    }
+    return size;
+}
+
+// запись базы (тег, длина, сообщение) читается одним CodedInputStream, его длина - int
+bool FitsSection(int field_number, size_t message_size) {
+    return WireFormatLite::TagSize(field_number, WireFormatLite::TYPE_MESSAGE)
+        + WireFormatLite::LengthDelimitedSize(message_size) <= static_cast<size_t>(INT_MAX);
+}
+
+} // namespace
+
+void Serializer::WriteRouter(google::protobuf::io::CodedOutputStream& output) const {
+    if(!routing_indexes_.router || !serialize_settings_.router_file.empty()) {
+        return;
+    }
+    const graph::Router<BusRouteWeight>::RoutesInternalData& routes_internal_data = routing_indexes_.router->GetRoutesInternalData();
+    const size_t component_count = routes_internal_data.GetComponentCount();
+    const size_t row_tag_size = WireFormatLite::TagSize(tc_pb::RouterComponent::kRowsFieldNumber,
+                                                        WireFormatLite::TYPE_MESSAGE);
+    const size_t vertices_tag_size = WireFormatLite::TagSize(tc_pb::RouterComponent::kVerticesFieldNumber,
+                                                             WireFormatLite::TYPE_UINT32);
+    const size_t component_tag_size = WireFormatLite::TagSize(tc_pb::Router::kComponentsFieldNumber,
+                                                              WireFormatLite::TYPE_MESSAGE);
+
+    // длина сообщения пишется перед ним, поэтому первый проход только считает размеры строк
+    tc_pb::PackedRouteRow pb_row;
+    std::vector<size_t> component_sizes(component_count, 0);
+    size_t router_size = 0;
+    for (size_t component = 0; component < component_count; ++component) {
+        const auto& block = routes_internal_data.GetBlock(component);
+        size_t& component_size = component_sizes[component];
+
+        const size_t vertices_size = PackedVerticesSize(routes_internal_data.GetComponentVertices(component));
+        if(vertices_size != 0) {
+            component_size += vertices_tag_size + WireFormatLite::LengthDelimitedSize(vertices_size);
+        }
+        for (graph::VertexId from = 0; from < block.GetVertexCount(); ++from) {
+            FillPbRouteRow(block, from, pb_row);
+            component_size += row_tag_size + WireFormatLite::LengthDelimitedSize(pb_row.ByteSizeLong());
+        }
+        router_size += component_tag_size + WireFormatLite::LengthDelimitedSize(component_size);
+    }
+    if(!FitsSection(tc_pb::TransportBase::kRouterFieldNumber, router_size)) {
+        throw std::runtime_error("Routes matrix is too large for the base file ("
+            + std::to_string(router_size) + " bytes): use router_file or the mapped format");
+    }
+
+    WireFormatLite::WriteTag(tc_pb::TransportBase::kRouterFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+    output.WriteVarint64(router_size);
+    for (size_t component = 0; component < component_count; ++component) {
+        const auto& block = routes_internal_data.GetBlock(component);
+        const std::vector<graph::VertexId>& vertices = routes_internal_data.GetComponentVertices(component);
+
+        WireFormatLite::WriteTag(tc_pb::Router::kComponentsFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+        output.WriteVarint64(component_sizes[component]);
+
+        if(const size_t vertices_size = PackedVerticesSize(vertices); vertices_size != 0) {
+            WireFormatLite::WriteTag(tc_pb::RouterComponent::kVerticesFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+            output.WriteVarint64(vertices_size);
+            for(const graph::VertexId vertex : vertices) {
+                output.WriteVarint32(static_cast<uint32_t>(vertex));
+            }
+        }
+        for (graph::VertexId from = 0; from < block.GetVertexCount(); ++from) {
+            FillPbRouteRow(block, from, pb_row);
+            WireFormatLite::WriteTag(tc_pb::RouterComponent::kRowsFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+            output.WriteVarint64(pb_row.ByteSizeLong());
+            pb_row.SerializeWithCachedSizes(&output);
+        }
+    }
+}
+
+bool Serializer::WriteSections(google::protobuf::io::ZeroCopyOutputStream& raw_output) const {
+    tc_pb::BaseIndex pb_index;
+    bool had_error = false;
+    // у каждой записи свой CodedOutputStream: его ByteCount - int, смещения берутся у raw_output
+    const auto write_section = [&pb_index, &raw_output, &had_error](int field_number, const auto& write) {
+        const int64_t offset = raw_output.ByteCount();
+        {
+            google::protobuf::io::CodedOutputStream output(&raw_output);
+            write(output);
+            output.Trim();
+            had_error = had_error || output.HadError();
+        }
+        if(raw_output.ByteCount() != offset) {
+            tc_pb::BaseSection* pb_section = pb_index.add_sections();
+            pb_section->set_field_number(field_number);
+            pb_section->set_offset(offset);
+            pb_section->set_size(raw_output.ByteCount() - offset);
+        }
+    };
+
+    const google::protobuf::Reflection* reflection = pb_base_.GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    reflection->ListFields(pb_base_, &fields);
+    for(const google::protobuf::FieldDescriptor* field : fields) {
+        const google::protobuf::Message& pb_section = reflection->GetMessage(pb_base_, field);
+        const size_t section_size = pb_section.ByteSizeLong();
+        if(!FitsSection(field->number(), section_size)) {
+            throw std::runtime_error("Base field " + field->name() + " is too large ("
+                + std::to_string(section_size) + " bytes)");
+        }
+        write_section(field->number(), [&](google::protobuf::io::CodedOutputStream& output) {
+            WireFormatLite::WriteTag(field->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+            output.WriteVarint64(section_size);
+            pb_section.SerializeWithCachedSizes(&output);
+        });
+    }
+
+    write_section(tc_pb::TransportBase::kRouterFieldNumber, [this](google::protobuf::io::CodedOutputStream& output) {
+        WriteRouter(output);
+    });
+
+    const int64_t index_offset = raw_output.ByteCount();
+    google::protobuf::io::CodedOutputStream output(&raw_output);
+    WireFormatLite::WriteTag(tc_pb::TransportBase::kIndexFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, &output);
+    output.WriteVarint64(pb_index.ByteSizeLong());
+    pb_index.SerializeWithCachedSizes(&output);
+    WireFormatLite::WriteFixed64(tc_pb::TransportBase::kIndexOffsetFieldNumber, index_offset, &output);
+    output.Trim();
+    return !had_error && !output.HadError();
+}
+
 } // namespace Serialize
 
@@ -3,16 +3,40 @@
 #include "transport_catalogue.h"
 #include "map_renderer.h"
 #include "transport_router.h"
+#include "mapped_base.h"
 #include "transport_catalogue.pb.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace Serialize {
 
+// формат файла базы
+enum class BaseFormat {
+    // tc_pb::TransportBase целиком
+    PROTOBUF,
+    // массивы записей фиксированного размера для отображения в память (mapped_base.h)
+    MAPPED,
+};
+
 struct SerializeSettings {
     std::string file;
+    // Файл матрицы маршрутов по всем парам (RouterType::ALL_PAIRS). Если задан,
+    // матрица пишется в него, а не в базу, и при обработке запросов отображается в память.
+    std::string router_file;
+    // не задан - PROTOBUF при создании базы, прежний формат при дополнении
+    std::optional<BaseFormat> format;
 };
 
 class Serializer {
@@ -23,13 +47,13 @@ public:
                 const catalogue::TransportRouter& transport_router,
                 const renderer::RenderSettings& render_settings,
                 const SerializeSettings serialization_settings,
-                const graph::Router<BusRouteWeight>& router)
+                catalogue::RoutingIndexes routing_indexes)
         : catalogue_(catalogue)
         , routing_settings_(transport_router.GetRoutingSettings())
         , render_settings_(render_settings)
         , serialize_settings_(serialization_settings)
         , transport_router_(transport_router)
-        , router_(router)
+        , routing_indexes_(routing_indexes)
     {
         // Заполнить pb_catalogue_
         tc_pb::TransportCatalogue pb_catalogue_;
@@ -64,6 +88,9 @@ public:
             default:
                 break;
             }
+            for(double departure : bus.departures_) {
+                pb_bus.add_departures(departure);
+            }
             pb_catalogue_.mutable_buses()->Add(std::move(pb_bus));
         }
 
@@ -103,17 +130,54 @@ public:
         FillTransportRouter();
 
         FillRouter();
+
+        FillContractionHierarchy();
+
+        FillHubLabels();
+
+        FillCustomizableContractionHierarchy();
+
+        FillTimetable();
     }
 
+    // Пишет базу под временным именем и переименовывает: process_requests держит
+    // прежнюю базу отображенной и дочитывает разделы по смещениям ее оглавления
     void SaveTo(const std::filesystem::path& path) const {
-        std::ofstream out(path, std::ios::binary);
-
-        pb_base_.SerializeToOstream(&out);
+        std::filesystem::path temp_path = path;
+        temp_path += ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if(!out) {
+                throw std::runtime_error("Can't create base file " + temp_path.string());
+            }
+            bool written = false;
+            {
+                google::protobuf::io::OstreamOutputStream raw_output(&out);
+                written = WriteSections(raw_output);
+            }
+            out.flush();
+            if(!written || !out) {
+                throw std::runtime_error("Can't write base file " + temp_path.string());
+            }
+        }
+        std::filesystem::rename(temp_path, path);
     }
 
     void Save() const {
-        std::ofstream out(std::filesystem::path(serialize_settings_.file), std::ios::binary);
-        pb_base_.SerializeToOstream(&out);
+        if(routing_indexes_.router && !serialize_settings_.router_file.empty()) {
+            graph::WriteRoutesFile(serialize_settings_.router_file, routing_indexes_.router->GetRoutesInternalData());
+        }
+        if(serialize_settings_.format == BaseFormat::MAPPED) {
+            // справочник, граф и матрица - разделами базы, остальное - protobuf
+            tc_pb::TransportBase pb_rest = pb_base_;
+            pb_rest.clear_cat();
+            pb_rest.clear_transport_router();
+            WriteMappedBase(serialize_settings_.file, catalogue_, transport_router_,
+                            serialize_settings_.router_file.empty() ? routing_indexes_.router : nullptr,
+                            pb_rest.SerializeAsString());
+            return;
+        }
+        SaveTo(serialize_settings_.file);
     }
     
 private:
@@ -122,9 +186,20 @@ private:
     const renderer::RenderSettings& render_settings_;
     const SerializeSettings serialize_settings_;
     const catalogue::TransportRouter& transport_router_;
-    const graph::Router<BusRouteWeight>& router_;
+    // заполнены только структуры выбранного RouterType
+    const catalogue::RoutingIndexes routing_indexes_;
     tc_pb::TransportBase pb_base_;
 
+    // Дописывает матрицу маршрутов по всем парам полем router после остальных полей
+    // pb_base_: protobuf склеивает поля сообщения в любом порядке, и файл читается
+    // как tc_pb::TransportBase. Строки строятся и пишутся по одной, в памяти - одна строка.
+    void WriteRouter(google::protobuf::io::CodedOutputStream& output) const;
+    // Пишет поля pb_base_ и матрицу отдельными записями, за ними - оглавление index
+    // со смещениями записей и последней записью - index_offset. Смещения 64-битные,
+    // но каждая запись читается одним CodedInputStream и не длиннее INT_MAX байт -
+    // иначе std::runtime_error до записи. false - ошибка записи в raw_output.
+    bool WriteSections(google::protobuf::io::ZeroCopyOutputStream& raw_output) const;
+
 
     struct RenderSettingsColorVisitor {
         tc_pb::Color& pb_color;
@@ -157,6 +232,53 @@ private:
         pb_routing_settings_.set_bus_velocity(routing_settings_.bus_velocity);
         pb_routing_settings_.set_bus_wait_time(routing_settings_.bus_wait_time);
 
+        switch (routing_settings_.router_type)
+        {
+        case catalogue::RouterType::ALL_PAIRS:
+            pb_routing_settings_.set_router_type(tc_pb::ALL_PAIRS);
+            break;
+        case catalogue::RouterType::DIJKSTRA:
+            pb_routing_settings_.set_router_type(tc_pb::DIJKSTRA);
+            break;
+        case catalogue::RouterType::CONTRACTION_HIERARCHIES:
+            pb_routing_settings_.set_router_type(tc_pb::CONTRACTION_HIERARCHIES);
+            break;
+        case catalogue::RouterType::A_STAR:
+            pb_routing_settings_.set_router_type(tc_pb::A_STAR);
+            break;
+        case catalogue::RouterType::HUB_LABELS:
+            pb_routing_settings_.set_router_type(tc_pb::HUB_LABELS);
+            break;
+        case catalogue::RouterType::CUSTOMIZABLE_CONTRACTION_HIERARCHIES:
+            pb_routing_settings_.set_router_type(tc_pb::CUSTOMIZABLE_CONTRACTION_HIERARCHIES);
+            break;
+        default:
+            break;
+        }
+        pb_routing_settings_.set_router_cache_size(routing_settings_.router_cache_size);
+        pb_routing_settings_.set_graph_model(
+            routing_settings_.graph_model == catalogue::GraphModel::SINGLE_VERTEX
+                ? tc_pb::SINGLE_VERTEX
+                : tc_pb::ARRIVAL_DEPARTURE);
+        switch (routing_settings_.vertex_order)
+        {
+        case catalogue::VertexOrder::HILBERT:
+            pb_routing_settings_.set_vertex_order(tc_pb::HILBERT);
+            break;
+        case catalogue::VertexOrder::REVERSE_CUTHILL_MCKEE:
+            pb_routing_settings_.set_vertex_order(tc_pb::REVERSE_CUTHILL_MCKEE);
+            break;
+        default:
+            pb_routing_settings_.set_vertex_order(tc_pb::INPUT);
+            break;
+        }
+        for(const auto& [name, profile] : routing_settings_.profiles) {
+            tc_pb::RoutingProfile& pb_profile = *pb_routing_settings_.add_profiles();
+            pb_profile.set_name(name);
+            pb_profile.set_bus_wait_time(profile.bus_wait_time);
+            pb_profile.set_bus_velocity(profile.bus_velocity);
+        }
+
         *pb_base_.mutable_routing_settings() = std::move(pb_routing_settings_);
     }
 
@@ -210,6 +332,9 @@ private:
             pb_transport_router.mutable_route_graph()->mutable_edges()->Add(std::move(pb_edge));
         }
 
+        for(graph::EdgeId offset : g.GetIncidenceOffsets()) {
+            pb_transport_router.mutable_route_graph()->add_incidence_offsets(offset);
+        }
         for(const std::vector<graph::EdgeId>& incidence_list : g.GetIncidenceLists()) {
             // одна строка с таблице - ее индекс соответствует vertex_id - from
             tc_pb::IncidenceList pb_incidence_list;
@@ -239,45 +364,138 @@ private:
                 
             }
         }
+        for(const double ride_time : transport_router_.GetEdgeIndexToRideTime()) {
+            pb_transport_router.add_edge_index_to_ride_time(ride_time);
+        }
         // pb_transport_router заполнен
         *pb_base_.mutable_transport_router() = std::move(pb_transport_router);
     }
 
     void FillRouter() {
+        if(!routing_indexes_.router) {
+            return;
+        }
+        if (!serialize_settings_.router_file.empty()) {
+            // сама матрица пишется в Save()
+            tc_pb::Router pb_router;
+            pb_router.set_routes_file(serialize_settings_.router_file);
+            *pb_base_.mutable_router() = std::move(pb_router);
+        }
+        // иначе матрица - раздел базы MAPPED или поле router базы PROTOBUF,
+        // пишется в Save() по строке, без копии в pb_base_
+    }
 
-        using RouteInternalData = graph::Router<BusRouteWeight>::RouteInternalData;
+    void FillContractionHierarchy() {
+        if(!routing_indexes_.contraction_hierarchy) {
+            return;
+        }
+        const auto& contraction_hierarchy = *routing_indexes_.contraction_hierarchy;
 
-        tc_pb::Router pb_router;
+        tc_pb::ContractionHierarchy pb_contraction_hierarchy;
+        for(size_t rank : contraction_hierarchy.GetRanks()) {
+            pb_contraction_hierarchy.add_ranks(rank);
+        }
+        for(const auto& edge : contraction_hierarchy.GetEdges()) {
+            tc_pb::ChEdge pb_edge;
+            pb_edge.set_vertex_id_from(edge.from);
+            pb_edge.set_vertex_id_to(edge.to);
+            pb_edge.mutable_weight()->set_time(edge.weight.time);
+            pb_edge.mutable_weight()->set_span(edge.weight.span);
+            if(edge.IsShortcut()) {
+                pb_edge.set_is_shortcut(true);
+                pb_edge.set_first_child(edge.first_child);
+                pb_edge.set_second_child(edge.second_child);
+            } else {
+                pb_edge.set_original_edge_id(edge.original_edge);
+            }
+            pb_contraction_hierarchy.mutable_edges()->Add(std::move(pb_edge));
+        }
 
-        for (const std::vector<std::optional<RouteInternalData>>& row : router_.GetRoutesInternalData()) {
-            
-            tc_pb::RouteInternalDataRow pb_row;
+        *pb_base_.mutable_contraction_hierarchy() = std::move(pb_contraction_hierarchy);
+    }
 
-            for(const std::optional<RouteInternalData>& data : row) {
-                if(data.has_value()) {
-                    tc_pb::RouteInternalData pb_data;
+    static void FillHubLabelSet(const graph::HubLabels<BusRouteWeight>::LabelSet& label_set, tc_pb::HubLabelSet& pb_label_set) {
+        for(uint32_t offset : label_set.offsets) {
+            pb_label_set.add_offsets(offset);
+        }
+        for(const auto& label : label_set.labels) {
+            tc_pb::HubLabel& pb_label = *pb_label_set.add_labels();
+            pb_label.set_hub(label.hub);
+            pb_label.set_parent_edge(label.parent_edge);
+            pb_label.mutable_weight()->set_time(label.weight.time);
+            pb_label.mutable_weight()->set_span(label.weight.span);
+        }
+    }
 
-                    pb_data.mutable_weight()->set_span(data->weight.span);
-                    pb_data.mutable_weight()->set_time(data->weight.time);
+    void FillHubLabels() {
+        if(!routing_indexes_.hub_labels) {
+            return;
+        }
+        const auto& hub_labels = *routing_indexes_.hub_labels;
 
-                    if(data->prev_edge.has_value()) {
-                        pb_data.mutable_prev_edge()->set_prev_edge_id(data->prev_edge.value());
-                    }
+        tc_pb::HubLabels pb_hub_labels;
+        for(graph::VertexId vertex : hub_labels.GetOrder()) {
+            pb_hub_labels.add_order(vertex);
+        }
+        FillHubLabelSet(hub_labels.GetOutLabels(), *pb_hub_labels.mutable_out_labels());
+        FillHubLabelSet(hub_labels.GetInLabels(), *pb_hub_labels.mutable_in_labels());
 
-                    pb_row.mutable_route_internal_data_row()->Add(std::move(pb_data));
+        *pb_base_.mutable_hub_labels() = std::move(pb_hub_labels);
+    }
 
-                } else {
-                    //добавление значения по умолчанию
-                    pb_row.add_route_internal_data_row();
-                }
-            }
+    void FillCustomizableContractionHierarchy() {
+        if(!routing_indexes_.customizable_contraction_hierarchy) {
+            return;
+        }
+        const auto& cch = *routing_indexes_.customizable_contraction_hierarchy;
 
-            pb_router.mutable_routes_internal_data()->Add(std::move(pb_row));
+        tc_pb::CustomizableContractionHierarchy pb_cch;
+        for(graph::VertexId vertex : cch.GetOrder()) {
+            pb_cch.add_order(vertex);
+        }
+        for(uint32_t offset : cch.GetArcOffsets()) {
+            pb_cch.add_arc_offsets(offset);
+        }
+        for(uint32_t head : cch.GetArcHeads()) {
+            pb_cch.add_arc_heads(head);
         }
 
-        *pb_base_.mutable_router() = std::move(pb_router);
+        *pb_base_.mutable_customizable_contraction_hierarchy() = std::move(pb_cch);
     }
 
+    void FillTimetable() {
+        if(!routing_indexes_.connection_scan) {
+            return;
+        }
+        const auto& connection_scan = *routing_indexes_.connection_scan;
+
+        tc_pb::Timetable pb_timetable;
+        for(const auto& trip : connection_scan.GetTrips()) {
+            tc_pb::TimetableTrip& pb_trip = *pb_timetable.add_trips();
+            pb_trip.set_bus_id(trip.bus->id);
+            pb_trip.set_departure_time(trip.departure_time);
+        }
+        for(const auto& connection : connection_scan.GetConnections()) {
+            tc_pb::TimetableConnection& pb_connection = *pb_timetable.add_connections();
+            pb_connection.set_from_stop_id(connection.from_stop);
+            pb_connection.set_to_stop_id(connection.to_stop);
+            pb_connection.set_departure_time(connection.departure_time);
+            pb_connection.set_arrival_time(connection.arrival_time);
+            pb_connection.set_trip(connection.trip);
+            pb_connection.set_trip_position(connection.trip_position);
+        }
+
+        *pb_base_.mutable_timetable() = std::move(pb_timetable);
+    }
+
+};
+
+// вхождение поля router в файл базы
+struct RouterSection {
+    // длины сообщения (за тегом)
+    uint64_t offset = 0;
+    // длины и сообщения вместе
+    uint64_t size = 0;
 };
 
 class Deserializer {
@@ -286,24 +504,19 @@ public:
     Deserializer(const std::filesystem::path& p)
         : open_path_(p)
     {
-        std::ifstream input_file(open_path_, std::ios::binary);
-        if(!input_file) {
-            throw std::runtime_error("Can't open file? bad path?");
-        }
-
-        pb_base_.ParseFromIstream(&input_file);
+        Load();
     }
     Deserializer(SerializeSettings settings)
         : open_path_(std::filesystem::path(settings.file))
         , serialize_settings_(settings)
 
     {
-        std::ifstream input_file(open_path_, std::ios::binary);
-        if(!input_file) {
-            throw std::runtime_error("Can't open file? bad path?");
-        }
+        Load();
+    }
 
-        pb_base_.ParseFromIstream(&input_file);
+    // база сохранена в формате BaseFormat::MAPPED
+    bool IsMappedBase() const {
+        return mapped_base_ != nullptr;
     }
 
     catalogue::TransportCatalogue GetTransportCatalogue() const;
@@ -312,11 +525,65 @@ public:
 
     catalogue::TransportRouter GetTransportRouter(const catalogue::TransportCatalogue& catalogue) const;
     graph::Router<BusRouteWeight> GetRouter(const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const;
+    // файл матрицы маршрутов, если она сохранена отдельно от базы
+    std::optional<std::filesystem::path> GetRoutesFile() const;
+    // матрицу можно отобразить в память: она в отдельном файле или в разделе базы MAPPED
+    bool HasMappedRouter() const;
+    std::unique_ptr<graph::MappedRouter<BusRouteWeight>> GetMappedRouter(
+        const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const;
+    std::unique_ptr<graph::ContractionHierarchy<BusRouteWeight>> GetContractionHierarchy(
+        const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const;
+    std::unique_ptr<graph::HubLabels<BusRouteWeight>> GetHubLabels(
+        const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const;
+    // nullptr, если иерархия не сохранена в базе
+    std::unique_ptr<graph::CustomizableContractionHierarchy<BusRouteWeight>> GetCustomizableContractionHierarchy(
+        const graph::DirectedWeightedGraph<BusRouteWeight>& graph) const;
+    // расписание; nullptr, если в базе нет автобусов с отправлениями
+    std::unique_ptr<catalogue::ConnectionScanRouter> GetConnectionScanRouter(
+        const catalogue::TransportCatalogue& catalogue) const;
+
+    // Прерывает загрузку, идущую в другом потоке: очередной раздел или строка матрицы
+    // вместо чтения бросает std::runtime_error. После вызова база больше не читается.
+    void CancelLoading() {
+        loading_cancelled_ = true;
+    }
 private:
+    // База PROTOBUF с оглавлением (Serializer пишет его последним) отображается в память,
+    // и каждый раздел разбирается при первом обращении к нему. База без оглавления
+    // (не длиннее INT_MAX байт) читается поле за полем сразу. В обоих случаях поле router с матрицей по всем парам
+    // не разбирается: запоминается его место в файле, и GetRouter читает строки
+    // матрицы по одной прямо в блоки.
+    void Load();
+    // false - в файле нет оглавления
+    bool LoadIndex();
+    // tc_pb::TransportBase, в котором заполнено только поле field_number
+    const tc_pb::TransportBase& GetSection(int field_number) const;
+    // routes_file_ и has_routes_matrix_ по полям router
+    void ScanRouterSections() const;
+    bool ReadRouterField(uint32_t tag, google::protobuf::io::CodedInputStream& input) const;
+    void ThrowIfLoadingCancelled() const;
+
     std::filesystem::path open_path_;
 
+    // без строк матрицы маршрутов; для базы с оглавлением пуст
     tc_pb::TransportBase pb_base_;
+    // база с оглавлением
+    std::unique_ptr<graph::MappedFile> file_;
+    tc_pb::BaseIndex pb_index_;
+    // разобранные разделы базы с оглавлением
+    mutable std::map<int, tc_pb::TransportBase> sections_;
+    mutable std::mutex sections_mutex_;
+    // все вхождения поля router
+    std::vector<RouterSection> router_sections_;
+    mutable bool router_scanned_ = false;
+    mutable std::string routes_file_;
+    // в полях router есть строки матрицы
+    mutable bool has_routes_matrix_ = false;
+    std::atomic<bool> loading_cancelled_{false};
     SerializeSettings serialize_settings_;
+    // для BaseFormat::MAPPED: справочник, граф и матрица читаются из отображения,
+    // pb_base_ - из раздела PROTOBUF
+    std::unique_ptr<MappedBase> mapped_base_;
 
     static svg::Color ExtractSVGColorFromPBColor(tc_pb::Color pb_color);
 };
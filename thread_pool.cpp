@@ -0,0 +1,102 @@
+#include "thread_pool.h"
+
+namespace parallel {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    for(size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(mutex_);
+        stop_ = true;
+    }
+    job_ready_.notify_all();
+    for(std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t task_count, const std::function<void(size_t)>& task) {
+    if(workers_.empty() || task_count <= 1) {
+        for(size_t i = 0; i < task_count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard guard(mutex_);
+        task_ = &task;
+        task_count_ = task_count;
+        next_task_ = 0;
+        pending_workers_ = workers_.size();
+        exception_ = nullptr;
+        ++generation_;
+    }
+    job_ready_.notify_all();
+
+    RunTasks();
+
+    std::unique_lock lock(mutex_);
+    // каждый рабочий поток должен отметиться в задании,
+    // иначе опоздавший поток мог бы увидеть уже следующее
+    job_done_.wait(lock, [this] { return pending_workers_ == 0; });
+    task_ = nullptr;
+    if(exception_) {
+        std::rethrow_exception(exception_);
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    uint64_t seen_generation = 0;
+    while(true) {
+        {
+            std::unique_lock lock(mutex_);
+            job_ready_.wait(lock, [this, seen_generation] {
+                return stop_ || generation_ != seen_generation;
+            });
+            if(stop_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+
+        RunTasks();
+
+        {
+            std::lock_guard guard(mutex_);
+            --pending_workers_;
+        }
+        job_done_.notify_one();
+    }
+}
+
+void ThreadPool::RunTasks() {
+    while(true) {
+        size_t index;
+        {
+            std::lock_guard guard(mutex_);
+            if(next_task_ >= task_count_ || exception_) {
+                return;
+            }
+            index = next_task_++;
+        }
+        try {
+            (*task_)(index);
+        } catch(...) {
+            std::lock_guard guard(mutex_);
+            if(!exception_) {
+                exception_ = std::current_exception();
+            }
+        }
+    }
+}
+
+} // namespace parallel
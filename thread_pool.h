@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// Пул рабочих потоков для выполнения пронумерованных независимых задач.
+// Вызывающий поток тоже выполняет задачи и ждет завершения всех.
+class ThreadPool {
+public:
+    // thread_count - общее число потоков вместе с вызывающим
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    // выполняет task(0) ... task(task_count - 1) и возвращает управление,
+    // когда все задачи завершены; исключение из задачи пробрасывается вызывающему
+    void ParallelFor(size_t task_count, const std::function<void(size_t)>& task);
+
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable job_done_;
+
+    // текущее задание, меняется только когда все рабочие потоки свободны
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t task_count_ = 0;
+    size_t next_task_ = 0;
+    uint64_t generation_ = 0;
+    size_t pending_workers_ = 0;
+    std::exception_ptr exception_;
+    bool stop_ = false;
+};
+
+} // namespace parallel
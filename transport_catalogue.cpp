@@ -1,9 +1,13 @@
 #include "transport_catalogue.h"
 
 namespace catalogue {
-void TransportCatalogue::AddBus(std::string_view name, const std::vector<std::string>& stops, BusType type) {
+void TransportCatalogue::AddBus(std::string_view name, const std::vector<std::string>& stops, BusType type,
+                                std::vector<double> departures) {
+    if(busname_to_bus_.count(name) != 0) {
+        throw std::logic_error("Bus already exists");
+    }
     std::vector<const Stop*> stops_ptr;
-    auto it = buses_.insert(buses_.end(), std::move(Bus{std::string(name), stops_ptr, type, bus_count_++}));
+    auto it = buses_.insert(buses_.end(), std::move(Bus{std::string(name), stops_ptr, type, bus_count_++, std::move(departures)}));
     
     for_each(stops.begin(), stops.end(), [&stops_ptr, &it, this](std::string_view stop_name){
         if(const Stop* stop_ptr = FindStop(stop_name)) { // если есть такая остановка в базе
@@ -17,6 +21,9 @@ void TransportCatalogue::AddBus(std::string_view name, const std::vector<std::st
 }
 
 void TransportCatalogue::AddStop(std::string_view name, Coordinates coordinates) {
+    if(stopname_to_stop_.count(name) != 0) {
+        throw std::logic_error("Stop already exists");
+    }
     auto it = stops_.emplace(stops_.end(), std::move(Stop{std::string(name), coordinates, stop_count_++}));
     stopname_to_stop_[std::string_view{it->name_}] = &(*it);
 }
@@ -190,6 +197,8 @@ TransportCatalogue::GetIntervalsToDistance() const {
 
 void TransportCatalogue::SetStops(std::deque<Stop>&& stops) {
     stops_.swap(stops);
+    // новые остановки продолжают нумерацию загруженных
+    stop_count_ = static_cast<int>(stops_.size());
 }
 
 void TransportCatalogue::SetStopnameToStop(std::map<std::string_view, const Stop*>&& stopname_to_stop) {
@@ -199,6 +208,7 @@ void TransportCatalogue::SetStopnameToStop(std::map<std::string_view, const Stop
 
 void TransportCatalogue::SetBuses(std::deque<Bus>&& buses) {
     buses_.swap(buses);
+    bus_count_ = static_cast<int>(buses_.size());
 }
 void TransportCatalogue::SetBusnameToBus(std::map<std::string_view, const Bus*>&& busname_to_bus) {
     busname_to_bus_ = busname_to_bus;
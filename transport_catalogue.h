@@ -66,7 +66,8 @@ public:
     TransportCatalogue() = default;
     // TransportCatalogue(RoutingSettings routing_settings);
 
-    void AddBus(std::string_view name, const std::vector<std::string>& stops, BusType type);
+    void AddBus(std::string_view name, const std::vector<std::string>& stops, BusType type,
+                std::vector<double> departures = {});
 
     void AddStop(std::string_view name, Coordinates coordinates);
 
@@ -121,6 +122,8 @@ private:
     BusStat ComputeBusInfo(std::string_view name) const;
 
     friend class TransportRouter;
+    friend class RaptorRouter;
+    friend class ConnectionScanRouter;
     
     
     // переменные счетчики для индексации
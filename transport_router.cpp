@@ -1,4 +1,12 @@
 #include "transport_router.h"
+#include "geo.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
 
 namespace catalogue {
 
@@ -18,6 +26,11 @@ void TransportRouter::SetRoutingSettings(RoutingSettings routing_settings) {
 }
 
 void TransportRouter::AddStopVertex(const Stop* stop) {
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        vertex_index_to_stop_.push_back(stop);
+        stopname_to_vertex_id_.emplace(stop->name_, vertex_index_to_stop_.size() - 1);
+        return;
+    }
     vertex_index_to_stop_.push_back(stop);
     vertex_index_to_stop_.push_back(stop);
     //Сохраняем только четные ид - приемные остановки, 
@@ -27,29 +40,301 @@ void TransportRouter::AddStopVertex(const Stop* stop) {
 
 void TransportRouter::AddBusWaitEdges() {
     //edge_index_to_bus_.resize(std::pow(stopname_to_stop_.size(), 3));
-    //вызов конструктора графа для известного на данный момент числа вершин графа
-    route_graph_ = std::move(graph::DirectedWeightedGraph<BusRouteWeight>(vertex_index_to_stop_.size()));
-    for(graph::VertexId vertex_from_id = 0; vertex_from_id < vertex_index_to_stop_.size(); vertex_from_id += 2) {
+    //в графе уже могут быть вершины - при дополнении существующей базы
+    const graph::VertexId first_new_vertex = route_graph_.GetVertexCount();
+    route_graph_.AddVertices(vertex_index_to_stop_.size() - first_new_vertex);
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        return;
+    }
+    for(graph::VertexId vertex_from_id = first_new_vertex; vertex_from_id < vertex_index_to_stop_.size(); vertex_from_id += 2) {
         route_graph_.AddEdge({vertex_from_id, vertex_from_id + 1, routing_settings_.bus_wait_time});
         edge_index_to_bus_.push_back(nullptr);
     }
 }
 
 void TransportRouter::AddBusEdges(std::string_view name) {
+    BusEdgesBuffer buffer;
+    BuildBusEdges(FindBusForEdges(name), buffer);
+    AppendBusEdges(std::move(buffer));
+}
+
+void TransportRouter::AddBusesEdges(const std::vector<std::string_view>& names, size_t thread_count) {
+    std::vector<const Bus*> buses;
+    buses.reserve(names.size());
+    for(std::string_view name : names) {
+        buses.push_back(FindBusForEdges(name));
+    }
+
+    // блок - непрерывный диапазон автобусов, у каждого блока свой буфер
+    const size_t block_count = std::min(buses.size(), std::max<size_t>(1, thread_count) * BUS_BLOCKS_PER_THREAD);
+    if(block_count == 0) {
+        return;
+    }
+    const size_t block_size = (buses.size() + block_count - 1) / block_count;
+    std::vector<BusEdgesBuffer> buffers(block_count);
+    auto build_block = [&](size_t block) {
+        const size_t end = std::min(buses.size(), (block + 1) * block_size);
+        for(size_t index = block * block_size; index < end; ++index) {
+            BuildBusEdges(buses[index], buffers[block]);
+        }
+    };
+    if(thread_count > 1) {
+        parallel::ThreadPool pool(thread_count);
+        pool.ParallelFor(block_count, build_block);
+    } else {
+        for(size_t block = 0; block < block_count; ++block) {
+            build_block(block);
+        }
+    }
+
+    // слияние в порядке блоков - тот же порядок ребер, что и при добавлении по одному
+    for(BusEdgesBuffer& buffer : buffers) {
+        AppendBusEdges(std::move(buffer));
+    }
+}
+
+const Bus* TransportRouter::FindBusForEdges(std::string_view name) const {
     if(cat_.busname_to_bus_.count(name) == 0) {
         throw std::logic_error("No such bus");
     }
-    const Bus* bus = cat_.busname_to_bus_.at(name);
+    return cat_.busname_to_bus_.at(name);
+}
+
+void TransportRouter::BuildBusEdges(const Bus* bus, BusEdgesBuffer& buffer) const {
     const std::vector<const Stop*>& stops = bus->stops_;
 
     if(bus->bus_type_ == BusType::CYCLED) {
-        AddBusStopsEdges(bus, stops.begin(), stops.end());
+        AddBusStopsEdges(bus, stops.begin(), stops.end(), buffer);
     } else {
-        AddBusStopsEdges(bus, stops.begin(), stops.end());
-        AddBusStopsEdges(bus, stops.rbegin(), stops.rend());
+        AddBusStopsEdges(bus, stops.begin(), stops.end(), buffer);
+        AddBusStopsEdges(bus, stops.rbegin(), stops.rend(), buffer);
     }
 }
 
+void TransportRouter::AppendBusEdges(BusEdgesBuffer&& buffer) {
+    for(const graph::Edge<BusRouteWeight>& edge : buffer.edges) {
+        route_graph_.AddEdge(edge);
+    }
+    edge_index_to_bus_.insert(edge_index_to_bus_.end(), buffer.buses.begin(), buffer.buses.end());
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        edge_index_to_ride_time_.insert(edge_index_to_ride_time_.end(), buffer.ride_times.begin(), buffer.ride_times.end());
+    }
+}
+
+size_t TransportRouter::PruneDominatedEdges() {
+    if(route_graph_.IsFrozen()) {
+        throw std::logic_error("Can't prune frozen route graph");
+    }
+    graph::DirectedWeightedGraph<BusRouteWeight> pruned_graph(route_graph_.GetVertexCount());
+    std::vector<const Bus*> edge_index_to_bus;
+    std::vector<double> edge_index_to_ride_time;
+
+    // лучшее ребро до каждой вершины назначения - для текущей вершины отправления
+    std::unordered_map<graph::VertexId, graph::EdgeId> best_edges;
+    for(graph::VertexId vertex_from = 0; vertex_from < route_graph_.GetVertexCount(); ++vertex_from) {
+        best_edges.clear();
+        for(const graph::EdgeId edge_id : route_graph_.GetIncidentEdges(vertex_from)) {
+            const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+            auto [it, inserted] = best_edges.emplace(edge.to, edge_id);
+            if(!inserted && edge.weight < route_graph_.GetEdge(it->second).weight) {
+                it->second = edge_id;
+            }
+        }
+        // порядок оставшихся ребер сохраняется
+        for(const graph::EdgeId edge_id : route_graph_.GetIncidentEdges(vertex_from)) {
+            const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+            if(best_edges.at(edge.to) == edge_id) {
+                pruned_graph.AddEdge(edge);
+                edge_index_to_bus.push_back(edge_index_to_bus_[edge_id]);
+                if(!edge_index_to_ride_time_.empty()) {
+                    edge_index_to_ride_time.push_back(edge_index_to_ride_time_[edge_id]);
+                }
+            }
+        }
+    }
+
+    const size_t removed_count = route_graph_.GetEdgeCount() - pruned_graph.GetEdgeCount();
+    route_graph_ = std::move(pruned_graph);
+    edge_index_to_bus_ = std::move(edge_index_to_bus);
+    edge_index_to_ride_time_ = std::move(edge_index_to_ride_time);
+    return removed_count;
+}
+
+void TransportRouter::RenumberVertices() {
+    if(route_graph_.IsFrozen()) {
+        throw std::logic_error("Can't renumber vertices of frozen route graph");
+    }
+    // остановка занимает в графе одну или две соседние вершины и переставляется целиком
+    const size_t vertices_per_stop = routing_settings_.graph_model == GraphModel::SINGLE_VERTEX ? 1 : 2;
+    const size_t stop_count = vertex_index_to_stop_.size() / vertices_per_stop;
+    std::vector<const Stop*> stops(stop_count);
+    for(size_t stop = 0; stop < stop_count; ++stop) {
+        stops[stop] = vertex_index_to_stop_[stop * vertices_per_stop];
+    }
+
+    std::vector<size_t> new_to_old;
+    switch(routing_settings_.vertex_order) {
+    case VertexOrder::HILBERT:
+        new_to_old = GetHilbertStopOrder(stops);
+        break;
+    case VertexOrder::REVERSE_CUTHILL_MCKEE:
+        new_to_old = GetReverseCuthillMcKeeStopOrder(stop_count, vertices_per_stop);
+        break;
+    default:
+        return;
+    }
+
+    std::vector<graph::VertexId> old_to_new_vertex(vertex_index_to_stop_.size());
+    std::deque<const Stop*> vertex_index_to_stop;
+    stopname_to_vertex_id_.clear();
+    for(size_t new_stop = 0; new_stop < stop_count; ++new_stop) {
+        const size_t old_stop = new_to_old[new_stop];
+        stopname_to_vertex_id_.emplace(stops[old_stop]->name_, vertex_index_to_stop.size());
+        for(size_t i = 0; i < vertices_per_stop; ++i) {
+            old_to_new_vertex[old_stop * vertices_per_stop + i] = vertex_index_to_stop.size();
+            vertex_index_to_stop.push_back(stops[old_stop]);
+        }
+    }
+
+    // ребра добавляются в прежнем порядке - EdgeId и соответствие ребро -> автобус те же
+    graph::DirectedWeightedGraph<BusRouteWeight> route_graph(route_graph_.GetVertexCount());
+    for(graph::EdgeId edge_id = 0; edge_id < route_graph_.GetEdgeCount(); ++edge_id) {
+        const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+        route_graph.AddEdge({old_to_new_vertex[edge.from], old_to_new_vertex[edge.to], edge.weight});
+    }
+    route_graph_ = std::move(route_graph);
+    vertex_index_to_stop_ = std::move(vertex_index_to_stop);
+}
+
+std::vector<size_t> TransportRouter::GetHilbertStopOrder(const std::vector<const Stop*>& stops) const {
+    if(stops.empty()) {
+        return {};
+    }
+    double min_lat = stops.front()->cordinates_.lat;
+    double max_lat = min_lat;
+    double min_lng = stops.front()->cordinates_.lng;
+    double max_lng = min_lng;
+    for(const Stop* stop : stops) {
+        min_lat = std::min(min_lat, stop->cordinates_.lat);
+        max_lat = std::max(max_lat, stop->cordinates_.lat);
+        min_lng = std::min(min_lng, stop->cordinates_.lng);
+        max_lng = std::max(max_lng, stop->cordinates_.lng);
+    }
+
+    // координаты - в клетки решетки HILBERT_GRID_SIZE x HILBERT_GRID_SIZE
+    constexpr uint32_t HILBERT_GRID_SIZE = 1u << 16;
+    const auto to_cell = [](double value, double min_value, double max_value) {
+        if(max_value <= min_value) {
+            return uint32_t{0};
+        }
+        return static_cast<uint32_t>((value - min_value) / (max_value - min_value) * (HILBERT_GRID_SIZE - 1));
+    };
+    std::vector<std::pair<uint64_t, size_t>> keys;
+    keys.reserve(stops.size());
+    for(size_t stop = 0; stop < stops.size(); ++stop) {
+        uint32_t x = to_cell(stops[stop]->cordinates_.lng, min_lng, max_lng);
+        uint32_t y = to_cell(stops[stop]->cordinates_.lat, min_lat, max_lat);
+        // номер клетки на кривой: по четвертям от крупных к мелким с поворотом четверти
+        uint64_t distance = 0;
+        for(uint32_t half = HILBERT_GRID_SIZE / 2; half > 0; half /= 2) {
+            const uint32_t rx = (x & half) != 0 ? 1 : 0;
+            const uint32_t ry = (y & half) != 0 ? 1 : 0;
+            distance += static_cast<uint64_t>(half) * half * ((3 * rx) ^ ry);
+            if(ry == 0) {
+                if(rx == 1) {
+                    x = HILBERT_GRID_SIZE - 1 - x;
+                    y = HILBERT_GRID_SIZE - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        keys.emplace_back(distance, stop);
+    }
+    // в одной клетке - в прежнем порядке
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<size_t> result;
+    result.reserve(keys.size());
+    for(const auto& [_, stop] : keys) {
+        result.push_back(stop);
+    }
+    return result;
+}
+
+std::vector<size_t> TransportRouter::GetReverseCuthillMcKeeStopOrder(size_t stop_count, size_t vertices_per_stop) const {
+    // соседи остановки по ребрам поездок в обе стороны, без повторов
+    std::vector<std::vector<size_t>> neighbours(stop_count);
+    for(graph::EdgeId edge_id = 0; edge_id < route_graph_.GetEdgeCount(); ++edge_id) {
+        const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+        const size_t from = edge.from / vertices_per_stop;
+        const size_t to = edge.to / vertices_per_stop;
+        if(from != to) {
+            neighbours[from].push_back(to);
+            neighbours[to].push_back(from);
+        }
+    }
+    for(std::vector<size_t>& stop_neighbours : neighbours) {
+        std::sort(stop_neighbours.begin(), stop_neighbours.end());
+        stop_neighbours.erase(std::unique(stop_neighbours.begin(), stop_neighbours.end()), stop_neighbours.end());
+    }
+    const auto by_degree = [&neighbours](size_t lhs, size_t rhs) {
+        return neighbours[lhs].size() != neighbours[rhs].size()
+            ? neighbours[lhs].size() < neighbours[rhs].size()
+            : lhs < rhs;
+    };
+
+    // обход каждой компоненты - с остановки наименьшей степени, соседи - по возрастанию степени
+    std::vector<size_t> start_stops(stop_count);
+    std::iota(start_stops.begin(), start_stops.end(), size_t{0});
+    std::sort(start_stops.begin(), start_stops.end(), by_degree);
+    std::vector<bool> visited(stop_count, false);
+    std::vector<size_t> result;
+    result.reserve(stop_count);
+    std::vector<size_t> unvisited_neighbours;
+    for(const size_t start : start_stops) {
+        if(visited[start]) {
+            continue;
+        }
+        visited[start] = true;
+        // result - одновременно очередь обхода
+        result.push_back(start);
+        for(size_t head = result.size() - 1; head < result.size(); ++head) {
+            unvisited_neighbours.clear();
+            for(const size_t neighbour : neighbours[result[head]]) {
+                if(!visited[neighbour]) {
+                    visited[neighbour] = true;
+                    unvisited_neighbours.push_back(neighbour);
+                }
+            }
+            std::sort(unvisited_neighbours.begin(), unvisited_neighbours.end(), by_degree);
+            result.insert(result.end(), unvisited_neighbours.begin(), unvisited_neighbours.end());
+        }
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+std::vector<graph::EdgeId> TransportRouter::Freeze() {
+    const std::vector<graph::EdgeId> new_to_old = route_graph_.Freeze();
+    std::vector<const Bus*> edge_index_to_bus(new_to_old.size());
+    for(graph::EdgeId new_edge_id = 0; new_edge_id < new_to_old.size(); ++new_edge_id) {
+        edge_index_to_bus[new_edge_id] = edge_index_to_bus_[new_to_old[new_edge_id]];
+    }
+    edge_index_to_bus_ = std::move(edge_index_to_bus);
+    if(!edge_index_to_ride_time_.empty()) {
+        std::vector<double> edge_index_to_ride_time(new_to_old.size());
+        for(graph::EdgeId new_edge_id = 0; new_edge_id < new_to_old.size(); ++new_edge_id) {
+            edge_index_to_ride_time[new_edge_id] = edge_index_to_ride_time_[new_to_old[new_edge_id]];
+        }
+        edge_index_to_ride_time_ = std::move(edge_index_to_ride_time);
+    }
+    return new_to_old;
+}
+
+void TransportRouter::Unfreeze() {
+    route_graph_.Unfreeze();
+}
+
 graph::VertexId TransportRouter::GetStopVertexIndex(std::string_view stop_name) const {
     if(stopname_to_vertex_id_.count(stop_name) == 0) {
         throw std::logic_error("Invalid stop name - can't find VertexId");
@@ -57,6 +342,47 @@ graph::VertexId TransportRouter::GetStopVertexIndex(std::string_view stop_name)
     return stopname_to_vertex_id_.at(stop_name);
 }
 
+graph::VertexId TransportRouter::GetStopDepartureVertexIndex(std::string_view stop_name) const {
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        return GetStopVertexIndex(stop_name);
+    }
+    // "исходящая" вершина следует за "приемной"
+    return GetStopVertexIndex(stop_name) + 1;
+}
+
+double TransportRouter::GetBusRideTime(graph::EdgeId edge_id) const {
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        return edge_index_to_ride_time_.at(edge_id);
+    }
+    return GetEdgeByIndex(edge_id).weight.time;
+}
+
+double TransportRouter::GetBusRideTime(graph::EdgeId edge_id, const RoutingProfile& profile) const {
+    // длина поездки - целое число метров, восстанавливается по времени при основных настройках
+    const double distance = std::round(GetBusRideTime(edge_id) * routing_settings_.bus_velocity);
+    return distance / profile.bus_velocity;
+}
+
+std::vector<BusRouteWeight> TransportRouter::GetEdgeWeights(const RoutingProfile& profile) const {
+    // из параллельных ребер при любом профиле быстрее то же (короче), поэтому
+    // удаленные PruneDominatedEdges ребра не нужны и профилю
+    std::vector<BusRouteWeight> result;
+    result.reserve(route_graph_.GetEdgeCount());
+    for(graph::EdgeId edge_id = 0; edge_id < route_graph_.GetEdgeCount(); ++edge_id) {
+        const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+        BusRouteWeight weight = edge.weight;
+        if(!edge_index_to_bus_[edge_id]) {
+            weight.time = profile.bus_wait_time;
+        } else if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+            weight.time = profile.bus_wait_time + GetBusRideTime(edge_id, profile);
+        } else {
+            weight.time = GetBusRideTime(edge_id, profile);
+        }
+        result.push_back(weight);
+    }
+    return result;
+}
+
 const Bus* TransportRouter::GetBusByEdgeIndex(graph::EdgeId edge_id) const {
     if(edge_id < edge_index_to_bus_.size()) {
         return edge_index_to_bus_[edge_id];
@@ -66,6 +392,9 @@ const Bus* TransportRouter::GetBusByEdgeIndex(graph::EdgeId edge_id) const {
 }
 
 const graph::Edge<BusRouteWeight>& TransportRouter::GetEdgeByIndex(graph::EdgeId edge_id) const {
+    if(edge_id >= route_graph_.GetEdgeCount()) {
+        throw std::logic_error("Bad EdgeId requested!");
+    }
     return route_graph_.GetEdge(edge_id);
 }
 
@@ -76,22 +405,69 @@ const Stop* TransportRouter::GetStopByVertexIndex(graph::VertexId vertex_id) con
     return vertex_index_to_stop_[vertex_id];
 }
 
+bool TransportRouter::IsStopVertex(graph::VertexId vertex_id) const {
+    if(routing_settings_.graph_model == GraphModel::SINGLE_VERTEX) {
+        return vertex_id < vertex_index_to_stop_.size();
+    }
+    // вершины остановки идут парой: приемная - четная, "исходящая" - следующая за ней
+    return vertex_id < vertex_index_to_stop_.size() && vertex_id % 2 == 0;
+}
+
+graph::AStarRouter<BusRouteWeight>::LowerBound TransportRouter::GetTravelTimeLowerBound() const {
+    // Расстояния между остановками в справочнике задаются дорогами и могут быть
+    // меньше расстояния по прямой, поэтому скорость bus_velocity для оценки не годится.
+    // Берется наименьшее время на метр по прямой среди всех ребер - оценка
+    // тогда не превышает вес ни одного ребра и согласована (неравенство треугольника).
+    double min_time_per_meter = std::numeric_limits<double>::infinity();
+    for(graph::EdgeId edge_id = 0; edge_id < route_graph_.GetEdgeCount(); ++edge_id) {
+        const graph::Edge<BusRouteWeight>& edge = route_graph_.GetEdge(edge_id);
+        const double distance = geo::ComputeDistance(
+            vertex_index_to_stop_[edge.from]->cordinates_,
+            vertex_index_to_stop_[edge.to]->cordinates_);
+        if(distance > 0.0) {
+            min_time_per_meter = std::min(min_time_per_meter, edge.weight.time / distance);
+        }
+    }
+    if(min_time_per_meter == std::numeric_limits<double>::infinity()) {
+        // все остановки в одной точке - оценка вырождается в ноль
+        min_time_per_meter = 0.0;
+    }
+
+    std::vector<geo::Coordinates> coordinates;
+    coordinates.reserve(vertex_index_to_stop_.size());
+    for(const Stop* stop : vertex_index_to_stop_) {
+        coordinates.push_back(stop->cordinates_);
+    }
+    return [coordinates = std::move(coordinates), min_time_per_meter](graph::VertexId from, graph::VertexId to) {
+        BusRouteWeight result;
+        result.time = geo::ComputeDistance(coordinates[from], coordinates[to]) * min_time_per_meter;
+        return result;
+    };
+}
+
 const std::deque<const Stop*>& TransportRouter::GetVertexIndexToStop() const {
     return vertex_index_to_stop_;
 }
 
-const std::deque<const Bus*>& TransportRouter::GetEdgeIndexToBus() const {
+const std::vector<const Bus*>& TransportRouter::GetEdgeIndexToBus() const {
     return edge_index_to_bus_;
 }
 
+const std::vector<double>& TransportRouter::GetEdgeIndexToRideTime() const {
+    return edge_index_to_ride_time_;
+}
+
 void TransportRouter::SetRouteGraph(graph::DirectedWeightedGraph<BusRouteWeight>&& route_graph) {
-    route_graph_ = route_graph;
+    route_graph_ = std::move(route_graph);
 }
 void TransportRouter::SetVertexIndexToStop(std::deque<const Stop*>&& vertex_index_to_stop) {
     vertex_index_to_stop_ = vertex_index_to_stop;
 }
-void TransportRouter::SetEdgeIndexToBus(std::deque<const Bus*>&& edge_index_to_bus) {
-    edge_index_to_bus_ = edge_index_to_bus;
+void TransportRouter::SetEdgeIndexToBus(std::vector<const Bus*>&& edge_index_to_bus) {
+    edge_index_to_bus_ = std::move(edge_index_to_bus);
+}
+void TransportRouter::SetEdgeIndexToRideTime(std::vector<double>&& edge_index_to_ride_time) {
+    edge_index_to_ride_time_ = std::move(edge_index_to_ride_time);
 }
 void TransportRouter::SetStopnameToVertexId(std::map<std::string_view, graph::VertexId>&& stopname_to_vertex_id) {
     stopname_to_vertex_id_ = stopname_to_vertex_id;
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "transport_catalogue.h"
+#include "routes_matrix_kernels.h"
+#include "graph.h"
+#include "router.h"
+#include "contraction_hierarchy.h"
+#include "astar_router.h"
+#include "mapped_router.h"
+#include "hub_labels.h"
+#include "connection_scan_router.h"
+#include "customizable_contraction_hierarchy.h"
+
+#include <deque>
+#include <iterator>
+#include <map>
+#include <string>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace catalogue {
+
+// алгоритм поиска маршрута
+enum class RouterType {
+    // расчет всех пар кратчайших путей при создании базы
+    ALL_PAIRS,
+    // алгоритм Дейкстры на каждый запрос с кешем деревьев путей
+    DIJKSTRA,
+    // иерархия сжатия, строится при создании базы
+    CONTRACTION_HIERARCHIES,
+    // двунаправленный A* по координатам остановок на каждый запрос
+    A_STAR,
+    // метки хабов, строятся при создании базы; запрос - слияние двух меток
+    HUB_LABELS,
+    // настраиваемая иерархия сжатия: при создании базы - только порядок вершин и ярлыки,
+    // веса (в том числе профилей RoutingSettings::profiles) настраиваются при загрузке
+    CUSTOMIZABLE_CONTRACTION_HIERARCHIES,
+};
+
+// модель графа маршрутов
+enum class GraphModel {
+    // две вершины на остановку ("приемная" и "исходящая"), между ними - ребро ожидания
+    ARRIVAL_DEPARTURE,
+    // одна вершина на остановку, ожидание автобуса входит в вес ребра поездки.
+    // Время маршрута и участков то же, но из маршрутов с равным временем может быть выбран
+    // другой (иные автобусы и span_count): порядок релаксации ребер у графов разный
+    SINGLE_VERTEX,
+};
+
+// нумерация вершин графа при создании базы; вершины одной остановки всегда идут подряд
+enum class VertexOrder {
+    // в порядке добавления остановок
+    INPUT,
+    // остановки - вдоль кривой Гильберта по координатам
+    HILBERT,
+    // остановки - в обратном порядке обхода в ширину (Cuthill-McKee) по ребрам графа
+    REVERSE_CUTHILL_MCKEE,
+};
+
+// другие время ожидания и скорость для тех же ребер графа (например, час пик)
+struct RoutingProfile {
+    // мин
+    double bus_wait_time = 0.0;
+    // м/мин
+    double bus_velocity = 0.0;
+};
+
+struct RoutingSettings {
+    // время ожидания автобуса на остановке, мин
+    double bus_wait_time = 0.0;
+    // скорость автобуса, м/мин
+    double bus_velocity = 0.0;
+
+    RouterType router_type = RouterType::ALL_PAIRS;
+    // число деревьев кратчайших путей в кеше (для RouterType::DIJKSTRA)
+    size_t router_cache_size = 256;
+
+    GraphModel graph_model = GraphModel::ARRIVAL_DEPARTURE;
+    // соседние в графе или на карте остановки получают близкие VertexId - строки матрицы
+    // и списки ребер соседних вершин лежат рядом в памяти
+    VertexOrder vertex_order = VertexOrder::INPUT;
+
+    // профили по имени - выбираются в запросе Route полем "profile"
+    std::map<std::string, RoutingProfile> profiles;
+};
+
+// Рассчитанные при создании базы структуры поиска маршрута.
+// Заполнены только те, что нужны выбранному RouterType.
+struct RoutingIndexes {
+    const graph::Router<BusRouteWeight>* router = nullptr;
+    // та же матрица по всем парам, отображенная из файла (SerializeSettings::router_file)
+    const graph::MappedRouter<BusRouteWeight>* mapped_router = nullptr;
+    const graph::ContractionHierarchy<BusRouteWeight>* contraction_hierarchy = nullptr;
+    const graph::HubLabels<BusRouteWeight>* hub_labels = nullptr;
+    // для CUSTOMIZABLE_CONTRACTION_HIERARCHIES и для профилей при любом RouterType
+    const graph::CustomizableContractionHierarchy<BusRouteWeight>* customizable_contraction_hierarchy = nullptr;
+    // расписание рейсов - при любом RouterType, если у автобусов заданы отправления
+    const ConnectionScanRouter* connection_scan = nullptr;
+};
+
+class TransportRouter {
+public:
+    TransportRouter(RoutingSettings settings, const TransportCatalogue& cat);
+
+    const RoutingSettings& GetRoutingSettings() const;
+    void SetRoutingSettings(RoutingSettings routing_settings);
+
+    // добавляет вершины графа на остановку: "приемную" и "исходящую"
+    // или одну (GraphModel::SINGLE_VERTEX)
+    void AddStopVertex(const Stop* stop);
+    // добавляет в граф вершины новых остановок и ребра ожидания автобуса на них
+    // (в модели с одной вершиной на остановку ребер ожидания нет)
+    void AddBusWaitEdges();
+    // добавляет ребра поездок на автобусе между всеми парами остановок маршрута
+    void AddBusEdges(std::string_view name);
+    // То же для многих автобусов: ребра строятся параллельно блоками автобусов
+    // и добавляются в граф в порядке names - EdgeId не зависят от числа потоков
+    void AddBusesEdges(const std::vector<std::string_view>& names, size_t thread_count = 1);
+    // Оставляет из параллельных ребер (общие from и to) только самое быстрое,
+    // при равенстве - добавленное первым: маршрутизаторы выбирают именно его.
+    // EdgeId перенумеровываются, соответствие ребро -> автобус сохраняется.
+    // Возвращает число удаленных ребер. Только для незамороженного графа.
+    size_t PruneDominatedEdges();
+    // Перенумеровывает вершины по RoutingSettings::vertex_order (остановка сохраняет пару
+    // соседних вершин, "приемная" - первая). EdgeId не меняются, новое соответствие
+    // остановка -> вершина сохраняется в базе вместе с графом. Только для незамороженного графа.
+    void RenumberVertices();
+    // переводит граф в CSR для запросов; EdgeId перенумеровываются,
+    // соответствие ребро -> автобус переставляется вместе с ними.
+    // Возвращает перестановку: result[new_edge_id] = old_edge_id
+    std::vector<graph::EdgeId> Freeze();
+    // позволяет дополнить готовый граф остановками и автобусами, EdgeId не меняются
+    void Unfreeze();
+
+    graph::VertexId GetStopVertexIndex(std::string_view stop_name) const;
+    // вершина, из которой выходят ребра поездок с остановки
+    graph::VertexId GetStopDepartureVertexIndex(std::string_view stop_name) const;
+    // время поездки по ребру автобуса без ожидания на остановке отправления
+    double GetBusRideTime(graph::EdgeId edge_id) const;
+    // то же при весах профиля
+    double GetBusRideTime(graph::EdgeId edge_id, const RoutingProfile& profile) const;
+    // веса всех ребер графа при весах профиля, index = EdgeId
+    std::vector<BusRouteWeight> GetEdgeWeights(const RoutingProfile& profile) const;
+    const Bus* GetBusByEdgeIndex(graph::EdgeId edge_id) const;
+    const graph::Edge<BusRouteWeight>& GetEdgeByIndex(graph::EdgeId edge_id) const;
+    const Stop* GetStopByVertexIndex(graph::VertexId vertex_id) const;
+    // вершина - та, что возвращает GetStopVertexIndex для своей остановки (приемная)
+    bool IsStopVertex(graph::VertexId vertex_id) const;
+
+    // нижняя оценка времени поездки для A*: расстояние по прямой между остановками,
+    // деленное на наибольшую скорость (по прямой) среди ребер поездок графа
+    graph::AStarRouter<BusRouteWeight>::LowerBound GetTravelTimeLowerBound() const;
+
+    template <typename Weight>
+    const graph::DirectedWeightedGraph<Weight>& GetRouteGraph() const {
+        return route_graph_;
+    }
+
+    // ------- for serialization purposes
+    const std::deque<const Stop*>& GetVertexIndexToStop() const;
+    const std::vector<const Bus*>& GetEdgeIndexToBus() const;
+    const std::vector<double>& GetEdgeIndexToRideTime() const;
+
+    void SetRouteGraph(graph::DirectedWeightedGraph<BusRouteWeight>&& route_graph);
+    void SetVertexIndexToStop(std::deque<const Stop*>&& vertex_index_to_stop);
+    void SetEdgeIndexToBus(std::vector<const Bus*>&& edge_index_to_bus);
+    void SetEdgeIndexToRideTime(std::vector<double>&& edge_index_to_ride_time);
+    void SetStopnameToVertexId(std::map<std::string_view, graph::VertexId>&& stopname_to_vertex_id);
+
+private:
+    RoutingSettings routing_settings_;
+    const TransportCatalogue& cat_;
+
+    graph::DirectedWeightedGraph<BusRouteWeight> route_graph_;
+
+    // index = VertexId
+    std::deque<const Stop*> vertex_index_to_stop_;
+    // index = EdgeId, nullptr - ребро ожидания на остановке
+    std::vector<const Bus*> edge_index_to_bus_;
+    // index = EdgeId, время поездки без ожидания - только в модели с одной вершиной
+    // (вычитание ожидания из веса ребра дало бы другое округление, чем в модели с двумя)
+    std::vector<double> edge_index_to_ride_time_;
+    // остановка -> "приемная" вершина (в модели с одной вершиной - единственная)
+    std::map<std::string_view, graph::VertexId> stopname_to_vertex_id_;
+
+    // ребра поездок, построенные без изменения графа
+    struct BusEdgesBuffer {
+        std::vector<graph::Edge<BusRouteWeight>> edges;
+        // автобус каждого ребра
+        std::vector<const Bus*> buses;
+        // время поездки каждого ребра без ожидания
+        std::vector<double> ride_times;
+    };
+
+    const Bus* FindBusForEdges(std::string_view name) const;
+    void BuildBusEdges(const Bus* bus, BusEdgesBuffer& buffer) const;
+    void AppendBusEdges(BusEdgesBuffer&& buffer);
+
+    // порядок остановок графа: result[новый номер] = старый номер остановки в графе
+    std::vector<size_t> GetHilbertStopOrder(const std::vector<const Stop*>& stops) const;
+    std::vector<size_t> GetReverseCuthillMcKeeStopOrder(size_t stop_count, size_t vertices_per_stop) const;
+
+    template <typename It>
+    void AddBusStopsEdges(const Bus* bus, It begin, It end, BusEdgesBuffer& buffer) const;
+
+    // блоков автобусов на поток - для выравнивания нагрузки
+    static constexpr size_t BUS_BLOCKS_PER_THREAD = 4;
+};
+
+template <typename It>
+void TransportRouter::AddBusStopsEdges(const Bus* bus, It begin, It end, BusEdgesBuffer& buffer) const {
+    for(It from_it = begin; from_it != end; ++from_it) {
+        const graph::VertexId vertex_from = GetStopDepartureVertexIndex((*from_it)->name_);
+        // ожидание автобуса либо отдельное ребро, либо часть ребра поездки
+        const double wait_time = routing_settings_.graph_model == GraphModel::SINGLE_VERTEX
+            ? routing_settings_.bus_wait_time
+            : 0.0;
+        uint64_t distance = 0;
+        int span = 0;
+        for(It prev_it = from_it, to_it = std::next(from_it); to_it != end; prev_it = to_it, ++to_it) {
+            distance += cat_.GetDistance({*prev_it, *to_it});
+            ++span;
+            const double ride_time = static_cast<double>(distance) / routing_settings_.bus_velocity;
+            buffer.edges.push_back({
+                vertex_from,
+                GetStopVertexIndex((*to_it)->name_),
+                BusRouteWeight{wait_time + ride_time, span}
+            });
+            buffer.buses.push_back(bus);
+            buffer.ride_times.push_back(ride_time);
+        }
+    }
+}
+
+} // namespace catalogue